@@ -1,5 +0,0 @@
-#pragma once
-
-#include "ImageData.h"
-
-void ApplyKernel( const ImageData &in, ImageData &out );
@@ -0,0 +1,333 @@
+#include "Comparison.h"
+
+#include <cstring>
+#include <fstream>
+#include <atomic>
+#include <limits>
+#include <cmath>
+#include <mutex>
+
+#include "Basic.h"
+
+#include "ImageData.h"
+
+namespace Comparison
+{
+Tolerance::Tolerance() : channel( 0 ), pixels( 0 ), psnr( 0 ), ssim( 0 )
+{}
+
+Result::Result() : loaded( false ), identical( false ), passed( false ), mismatched( 0 ), maximum( 0 ), psnr{ 0, 0, 0, 0 }, ssim{ 0, 0, 0, 0 }
+{}
+
+static uint64_t mix( uint64_t h, uint64_t v )
+{
+    return ( ( h << 5 | h >> 59 ) ^ v ) * 0x9e3779b97f4a7c15ull;
+}
+
+uint64_t hash( const ImageDataBase &image )
+{
+    int w = image.w(), h = image.h();
+
+    // Rows are hashed concurrently and folded in order
+    std::vector<uint64_t> rows( h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = ( const unsigned char * )image( 0, i );
+            size_t size = ( size_t )w * sizeof( Pixel ), k = 0;
+
+            uint64_t r = 0, v;
+            for( ; k + 8 <= size; k += 8 )
+            {
+                std::memcpy( &v, p + k, 8 );
+                r = mix( r, v );
+            }
+            if( k < size )
+            {
+                v = 0;
+                std::memcpy( &v, p + k, size - k );
+                r = mix( r, v );
+            }
+            rows[i] = r;
+        }
+    } );
+
+    uint64_t result = mix( mix( 0, ( uint64_t )w ), ( uint64_t )h );
+    for( auto r : rows )
+        result = mix( result, r );
+
+    result ^= result >> 33;
+    result *= 0xff51afd7ed558ccdull;
+    result ^= result >> 33;
+    return result;
+}
+
+// Result of images with equal pixels
+static void same( Result &result, const Tolerance &tolerance )
+{
+    result.loaded = true;
+    result.identical = true;
+    result.passed = true;
+    for( int c = 0; c < 4; ++c )
+    {
+        result.psnr[c] = std::numeric_limits<double>::infinity();
+        result.ssim[c] = tolerance.ssim > 0 ? 1 : std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+// Running sums of windows along columns, then along rows, in interleaved channel order
+static void structural( const ImageDataBase &x, const ImageDataBase &y, double ssim[4] )
+{
+    int w = x.w(), h = x.h();
+    int k = Min( 7, Min( w, h ) );
+    int nw = w - k + 1, nh = h - k + 1;
+    int n = 4 * w;
+
+    const double c1 = Sqr( 0.01 * 255 ), c2 = Sqr( 0.03 * 255 );
+    const double scale = 1.0 / ( k * k );
+
+    std::vector<double> rows( ( size_t )nh * 4 );
+    Parallel::rows( nh, [&]( int begin, int end )
+    {
+        std::vector<int64_t> sx( n ), sy( n ), sxx( n ), syy( n ), sxy( n );
+
+        auto add = [&]( int i, int sign )
+        {
+            auto p = ( const unsigned char * )x( 0, i );
+            auto q = ( const unsigned char * )y( 0, i );
+            for( int j = 0; j < n; ++j )
+            {
+                int u = p[j], v = q[j];
+                sx[j] += sign * u;
+                sy[j] += sign * v;
+                sxx[j] += sign * u * u;
+                syy[j] += sign * v * v;
+                sxy[j] += sign * u * v;
+            }
+        };
+
+        for( int i = begin; i < begin + k; ++i )
+            add( i, 1 );
+
+        for( int i = begin; i < end; ++i )
+        {
+            int64_t wx[4] = {}, wy[4] = {}, wxx[4] = {}, wyy[4] = {}, wxy[4] = {};
+            for( int j = 0; j < 4 * k; ++j )
+            {
+                wx[j % 4] += sx[j];
+                wy[j % 4] += sy[j];
+                wxx[j % 4] += sxx[j];
+                wyy[j % 4] += syy[j];
+                wxy[j % 4] += sxy[j];
+            }
+
+            double total[4] = {};
+            for( int j = 0; ; ++j )
+            {
+                for( int c = 0; c < 4; ++c )
+                {
+                    double mx = wx[c] * scale, my = wy[c] * scale;
+                    double vx = wxx[c] * scale - mx * mx, vy = wyy[c] * scale - my * my;
+                    double cxy = wxy[c] * scale - mx * my;
+                    total[c] += ( 2 * mx * my + c1 ) * ( 2 * cxy + c2 ) / ( ( mx * mx + my * my + c1 ) * ( vx + vy + c2 ) );
+                }
+
+                if( j + 1 == nw )
+                    break;
+
+                for( int c = 0; c < 4; ++c )
+                {
+                    int in = 4 * ( j + k ) + c, out = 4 * j + c;
+                    wx[c] += sx[in] - sx[out];
+                    wy[c] += sy[in] - sy[out];
+                    wxx[c] += sxx[in] - sxx[out];
+                    wyy[c] += syy[in] - syy[out];
+                    wxy[c] += sxy[in] - sxy[out];
+                }
+            }
+
+            for( int c = 0; c < 4; ++c )
+                rows[( size_t )i * 4 + c] = total[c];
+
+            if( i + 1 < end )
+            {
+                add( i, -1 );
+                add( i + k, 1 );
+            }
+        }
+    } );
+
+    for( int c = 0; c < 4; ++c )
+    {
+        double sum = 0;
+        for( int i = 0; i < nh; ++i )
+            sum += rows[( size_t )i * 4 + c];
+        ssim[c] = sum / ( ( double )nw * nh );
+    }
+}
+
+Result compare( const ImageDataBase &actual, const ImageDataBase &expected, const Tolerance &tolerance, bool mask )
+{
+    Result result;
+    result.loaded = true;
+
+    int w = actual.w(), h = actual.h();
+    if( w != expected.w() || h != expected.h() )
+    {
+        result.mismatched = ( size_t )Max( ( long long )w * h, ( long long )expected.w() * expected.h() );
+        result.maximum = 255;
+        return result;
+    }
+
+    if( mask )
+        result.mask.reset( w, h, 0 );
+
+    std::atomic<bool> differ( false );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end && !differ; ++i )
+            if( std::memcmp( actual( 0, i ), expected( 0, i ), ( size_t )w * sizeof( Pixel ) ) )
+                differ = true;
+    } );
+
+    if( !differ )
+    {
+        same( result, tolerance );
+        return result;
+    }
+
+    // Squared errors and mismatches of every band are merged under a lock
+    uint64_t squared[4] = {};
+    std::mutex mutex;
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        uint64_t local[4] = {};
+        size_t mismatched = 0;
+        int maximum = 0;
+
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = ( const unsigned char * )actual( 0, i );
+            auto q = ( const unsigned char * )expected( 0, i );
+            auto m = mask ? result.mask( 0, i ) : nullptr;
+
+            for( int j = 0; j < w; ++j )
+            {
+                int d = 0;
+                for( int c = 0; c < 4; ++c )
+                {
+                    int e = Abs( p[4 * j + c] - q[4 * j + c] );
+                    local[c] += e * e;
+                    d = Max( d, e );
+                }
+
+                mismatched += d > tolerance.channel;
+                maximum = Max( maximum, d );
+                if( m )
+                    m[j] = ( unsigned char )d;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+        for( int c = 0; c < 4; ++c )
+            squared[c] += local[c];
+        result.mismatched += mismatched;
+        result.maximum = Max( result.maximum, maximum );
+    } );
+
+    double count = ( double )w * h;
+    for( int c = 0; c < 4; ++c )
+        result.psnr[c] = squared[c] ? 10 * std::log10( 255.0 * 255.0 * count / squared[c] ) : std::numeric_limits<double>::infinity();
+
+    if( tolerance.ssim > 0 )
+        structural( actual, expected, result.ssim );
+    else
+        std::fill( result.ssim, result.ssim + 4, std::numeric_limits<double>::quiet_NaN() );
+
+    result.passed = result.mismatched <= tolerance.pixels;
+    for( int c = 0; c < 4; ++c )
+    {
+        if( tolerance.psnr > 0 && result.psnr[c] < tolerance.psnr )
+            result.passed = false;
+        if( tolerance.ssim > 0 && result.ssim[c] < tolerance.ssim )
+            result.passed = false;
+    }
+
+    return result;
+}
+
+static bool read( const std::filesystem::path &path, std::vector<char> &content )
+{
+    std::ifstream file( path, std::ios::binary );
+    if( !file )
+        return false;
+
+    file.seekg( 0, std::ios::end );
+    content.resize( ( size_t )file.tellg() );
+    file.seekg( 0, std::ios::beg );
+    return ( bool )file.read( content.data(), content.size() );
+}
+
+std::filesystem::path hashPath( const std::filesystem::path &baseline )
+{
+    auto path = baseline;
+    return path.replace_extension( L".hash" );
+}
+
+bool store( const std::filesystem::path &baseline )
+{
+    ImageData image;
+    if( !image.input( baseline ) )
+        return false;
+
+    std::ofstream file( hashPath( baseline ), std::ios::binary );
+    auto value = hash( image );
+    return ( bool )file.write( ( const char * )&value, sizeof( value ) );
+}
+
+static bool load( const std::filesystem::path &baseline, uint64_t &value )
+{
+    std::ifstream file( hashPath( baseline ), std::ios::binary );
+    return file && file.read( ( char * )&value, sizeof( value ) );
+}
+
+std::vector<Result> compare( const std::vector<Pair> &pairs, const Tolerance &tolerance )
+{
+    std::vector<Result> results( pairs.size() );
+    Parallel::tasks( pairs.size(), [&]( size_t k )
+    {
+        auto &pair = pairs[k];
+        auto &result = results[k];
+
+        std::vector<char> a, b;
+        if( read( pair.actual, a ) && read( pair.expected, b ) && a == b )
+        {
+            same( result, tolerance );
+            return;
+        }
+
+        ImageData x, y;
+        if( !x.input( pair.actual ) )
+            return;
+
+        // Baselines with a stored hash are only decoded, when the hash of the actual pixels differs
+        uint64_t stored;
+        bool hashed = load( pair.expected, stored );
+        if( hashed && hash( x ) == stored )
+        {
+            same( result, tolerance );
+            return;
+        }
+
+        if( !y.input( pair.expected ) )
+        {
+            result.loaded = hashed;
+            return;
+        }
+
+        result = compare( x, y, tolerance );
+    } );
+    return results;
+}
+}
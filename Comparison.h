@@ -0,0 +1,61 @@
+#pragma once
+
+#include <filesystem>
+#include <cstdint>
+#include <vector>
+
+#include "ImageDataBase.h"
+
+// Comparison of images against baselines
+namespace Comparison
+{
+// Images pass, when at most pixels pixels differ by more than channel in some channel
+// and every channel reaches psnr and ssim, zero minimums are not checked
+class Tolerance
+{
+public:
+    int channel;
+    size_t pixels;
+    double psnr, ssim;
+
+    Tolerance();
+};
+
+class Result
+{
+public:
+    bool loaded;     // both images were read
+    bool identical;  // same size and same pixels
+    bool passed;     // identical or within tolerance
+    size_t mismatched;
+    int maximum;     // largest channel difference
+    double psnr[4];  // per channel in Pixel order, infinite for equal channels
+    double ssim[4];  // mean over 7 x 7 windows, NaN when the tolerance does not ask for it
+
+    // Largest channel difference of every pixel, only kept on request
+    MatrixBase<unsigned char> mask;
+
+    Result();
+};
+
+// Stable for equal pixels regardless of stride, so baselines can store it instead of pixels
+uint64_t hash( const ImageDataBase &image );
+
+// Rows are checked for equality first, statistics are only gathered for differing images
+Result compare( const ImageDataBase &actual, const ImageDataBase &expected, const Tolerance &tolerance = Tolerance(), bool mask = false );
+
+// Hash of the pixels of a baseline is kept next to it with the hash extension
+std::filesystem::path hashPath( const std::filesystem::path &baseline );
+bool store( const std::filesystem::path &baseline );
+
+class Pair
+{
+public:
+    std::filesystem::path actual, expected;
+};
+
+// Pairs are compared concurrently, files with equal bytes are identical without decoding,
+// so are actual images with the stored hash of their baselines, baselines may be kept as hashes alone,
+// which give results without statistics when they differ
+std::vector<Result> compare( const std::vector<Pair> &pairs, const Tolerance &tolerance = Tolerance() );
+}
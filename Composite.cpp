@@ -0,0 +1,382 @@
+#include "Composite.h"
+
+#include <array>
+#include <vector>
+
+#include "Exception.h"
+#include "Basic.h"
+
+#include "ImageData.h"
+
+namespace Composite
+{
+template<typename P>
+struct Traits;
+
+template<>
+struct Traits<Pixel>
+{
+    static constexpr uint32_t max = 255;
+
+    // Rounded x * y / 255 without division
+    static uint32_t mul( uint32_t x, uint32_t y )
+    {
+        uint32_t t = x * y + 128;
+        return ( t + ( t >> 8 ) ) >> 8;
+    }
+};
+
+template<>
+struct Traits<Pixel16>
+{
+    static constexpr uint32_t max = 65535;
+
+    static uint32_t mul( uint32_t x, uint32_t y )
+    {
+        uint32_t t = x * y + 32768;
+        return ( t + ( t >> 16 ) ) >> 16;
+    }
+};
+
+Pixel16::Pixel16( const Pixel &p ) : b( p.b * 257 ), g( p.g * 257 ), r( p.r * 257 ), a( p.a * 257 )
+{}
+
+Pixel16::operator const Pixel() const
+{
+    auto channel = []( uint32_t v )
+    {
+        return ( unsigned char )( ( v * 255 + 32767 ) / 65535 );
+    };
+    return Pixel( channel( r ), channel( g ), channel( b ), channel( a ) );
+}
+
+Pixel premultiply( const Pixel &p )
+{
+    using T = Traits<Pixel>;
+    return Pixel( T::mul( p.r, p.a ), T::mul( p.g, p.a ), T::mul( p.b, p.a ), p.a );
+}
+
+// 255 / a in 16.16 fixed point
+static const std::array<uint32_t, 256> reciprocal = []
+{
+    std::array<uint32_t, 256> table{};
+    for( uint32_t a = 1; a < 256; ++a )
+        table[a] = ( 255u * 65536 + a / 2 ) / a;
+    return table;
+}();
+
+Pixel unpremultiply( const Pixel &p )
+{
+    if( !p.a )
+        return Pixel( 0, 0, 0, 0 );
+
+    auto k = reciprocal[p.a];
+    auto channel = [k]( uint32_t c )
+    {
+        return ( unsigned char )Min<uint32_t>( ( c * k + 32768 ) >> 16, 255 );
+    };
+    return Pixel( channel( p.r ), channel( p.g ), channel( p.b ), p.a );
+}
+
+Pixel16 premultiply( const Pixel16 &p )
+{
+    using T = Traits<Pixel16>;
+    return Pixel16( T::mul( p.r, p.a ), T::mul( p.g, p.a ), T::mul( p.b, p.a ), p.a );
+}
+
+Pixel16 unpremultiply( const Pixel16 &p )
+{
+    if( !p.a )
+        return Pixel16( 0, 0, 0, 0 );
+
+    auto channel = [&]( uint64_t c )
+    {
+        return ( uint16_t )Min<uint64_t>( ( c * 65535 + p.a / 2 ) / p.a, 65535 );
+    };
+    return Pixel16( channel( p.r ), channel( p.g ), channel( p.b ), p.a );
+}
+
+// Fractions of source and destination, one is the value of full alpha
+template<typename V>
+static void factors( Operator op, V as, V ab, V one, V &fa, V &fb )
+{
+    switch( op )
+    {
+    case Operator::clear:
+        fa = 0;
+        fb = 0;
+        break;
+    case Operator::source:
+        fa = one;
+        fb = 0;
+        break;
+    case Operator::destination:
+        fa = 0;
+        fb = one;
+        break;
+    case Operator::over:
+        fa = one;
+        fb = one - as;
+        break;
+    case Operator::destinationOver:
+        fa = one - ab;
+        fb = one;
+        break;
+    case Operator::in:
+        fa = ab;
+        fb = 0;
+        break;
+    case Operator::destinationIn:
+        fa = 0;
+        fb = as;
+        break;
+    case Operator::out:
+        fa = one - ab;
+        fb = 0;
+        break;
+    case Operator::destinationOut:
+        fa = 0;
+        fb = one - as;
+        break;
+    case Operator::atop:
+        fa = ab;
+        fb = one - as;
+        break;
+    case Operator::destinationAtop:
+        fa = one - ab;
+        fb = as;
+        break;
+    case Operator::exclusiveOr:
+        fa = one - ab;
+        fb = one - as;
+        break;
+    case Operator::plus:
+        fa = one;
+        fb = one;
+        break;
+    default:
+        makeException( false );
+        break;
+    }
+}
+
+template<typename P>
+static void porterDuff( Operator op, const P *source, P *destination, int count )
+{
+    using T = Traits<P>;
+    using Channel = decltype( P::a );
+
+    for( int k = 0; k < count; ++k )
+    {
+        auto &s = source[k];
+        auto &d = destination[k];
+
+        uint32_t fa, fb;
+        factors<uint32_t>( op, s.a, d.a, T::max, fa, fb );
+
+        auto channel = [&]( uint32_t x, uint32_t y )
+        {
+            return ( Channel )Min( T::mul( x, fa ) + T::mul( y, fb ), T::max );
+        };
+
+        d = P( channel( s.r, d.r ), channel( s.g, d.g ), channel( s.b, d.b ), channel( s.a, d.a ) );
+    }
+}
+
+// Source over destination for two channels at once in every half of a 32 bit word
+static void over( const Pixel *source, Pixel *destination, int count )
+{
+    for( int k = 0; k < count; ++k )
+    {
+        auto &s = source[k];
+        auto &d = destination[k];
+        if( s.a == 255 )
+        {
+            d = s;
+            continue;
+        }
+        if( !s.a )
+            continue;
+
+        uint32_t ia = 255 - s.a;
+        uint32_t bg = ( uint32_t )d.b | ( uint32_t )d.g << 16;
+        uint32_t ra = ( uint32_t )d.r | ( uint32_t )d.a << 16;
+
+        bg = bg * ia + 0x00800080;
+        bg = ( ( bg + ( ( bg >> 8 ) & 0x00ff00ff ) ) >> 8 ) & 0x00ff00ff;
+        ra = ra * ia + 0x00800080;
+        ra = ( ( ra + ( ( ra >> 8 ) & 0x00ff00ff ) ) >> 8 ) & 0x00ff00ff;
+
+        d.b = ( unsigned char )( s.b + ( bg & 0xff ) );
+        d.g = ( unsigned char )( s.g + ( bg >> 16 ) );
+        d.r = ( unsigned char )( s.r + ( ra & 0xff ) );
+        d.a = ( unsigned char )( s.a + ( ra >> 16 ) );
+    }
+}
+
+template<typename P>
+static void blend( Blend mode, const P *source, P *destination, int count )
+{
+    using T = Traits<P>;
+    using Channel = decltype( P::a );
+    const int max = T::max;
+
+    auto mul = []( int x, int y )
+    {
+        return ( int )T::mul( x, y );
+    };
+
+    for( int k = 0; k < count; ++k )
+    {
+        auto &s = source[k];
+        auto &d = destination[k];
+
+        int as = s.a, ab = d.a;
+        int ao = as + ab - mul( as, ab );
+
+        // Blended part is alpha of both times blend of straight colors, written for premultiplied ones
+        auto channel = [&]( int cs, int cb )
+        {
+            int both;
+            switch( mode )
+            {
+            case Blend::normal:
+                both = mul( cs, ab );
+                break;
+            case Blend::multiply:
+                both = mul( cs, cb );
+                break;
+            case Blend::screen:
+                both = mul( cs, ab ) + mul( cb, as ) - mul( cs, cb );
+                break;
+            case Blend::overlay:
+                both = 2 * cb <= ab ? 2 * mul( cs, cb ) : mul( as, ab ) - 2 * mul( Max( ab - cb, 0 ), Max( as - cs, 0 ) );
+                break;
+            case Blend::add:
+                both = Min( mul( cs, ab ) + mul( cb, as ), mul( as, ab ) );
+                break;
+            default:
+                makeException( false );
+                both = 0;
+                break;
+            }
+
+            int c = mul( cs, max - ab ) + mul( cb, max - as ) + both;
+            return ( Channel )Min( Max( c, 0 ), ao );
+        };
+
+        d = P( channel( s.r, d.r ), channel( s.g, d.g ), channel( s.b, d.b ), ( Channel )ao );
+    }
+}
+
+void row( Operator op, const Pixel *source, Pixel *destination, int count )
+{
+    if( op == Operator::over )
+        over( source, destination, count );
+    else
+        porterDuff( op, source, destination, count );
+}
+
+void row( Operator op, const Pixel16 *source, Pixel16 *destination, int count )
+{
+    porterDuff( op, source, destination, count );
+}
+
+void row( Blend mode, const Pixel *source, Pixel *destination, int count )
+{
+    if( mode == Blend::normal )
+        over( source, destination, count );
+    else
+        blend( mode, source, destination, count );
+}
+
+void row( Blend mode, const Pixel16 *source, Pixel16 *destination, int count )
+{
+    blend( mode, source, destination, count );
+}
+
+// Rows of the covered area are premultiplied, combined and converted back concurrently
+template<typename F>
+static void rows( const ImageDataBase &source, ImageDataBase &destination, int x, int y, F combine )
+{
+    if( static_cast<const ImageDataBase *>( &destination ) == &source )
+    {
+        ImageData copy;
+        source.copy( copy );
+        rows( copy, destination, x, y, combine );
+        return;
+    }
+
+    int j0 = Max( x, 0 ), j1 = Min( x + source.w(), destination.w() );
+    int i0 = Max( y, 0 ), i1 = Min( y + source.h(), destination.h() );
+    if( j0 >= j1 || i0 >= i1 )
+        return;
+
+    // Destination pixels, which the operator left as they were, keep their straight colors,
+    // converting them back would lose precision of semi-transparent pixels
+    int n = j1 - j0;
+    Parallel::rows( i1 - i0, [&]( int begin, int end )
+    {
+        std::vector<Pixel> s( n ), d( n ), before( n );
+        for( int i = i0 + begin; i < i0 + end; ++i )
+        {
+            auto ps = source( j0 - x, i - y );
+            auto pd = destination( j0, i );
+            for( int k = 0; k < n; ++k )
+            {
+                s[k] = premultiply( ps[k] );
+                before[k] = d[k] = premultiply( pd[k] );
+            }
+
+            combine( s.data(), d.data(), n );
+
+            for( int k = 0; k < n; ++k )
+            {
+                if( d[k] != before[k] )
+                    pd[k] = unpremultiply( d[k] );
+            }
+        }
+    } );
+}
+
+void compose( const ImageDataBase &source, ImageDataBase &destination, int x, int y, Operator op )
+{
+    rows( source, destination, x, y, [op]( const Pixel * s, Pixel * d, int n )
+    {
+        row( op, s, d, n );
+    } );
+}
+
+void compose( const ImageDataBase &source, ImageDataBase &destination, int x, int y, Blend mode )
+{
+    rows( source, destination, x, y, [mode]( const Pixel * s, Pixel * d, int n )
+    {
+        row( mode, s, d, n );
+    } );
+}
+
+Color compose( Operator op, const Color &source, const Color &destination )
+{
+    double fa, fb;
+    factors<double>( op, source.a, destination.a, 1, fa, fb );
+
+    double sa = source.a * fa, da = destination.a * fb;
+    bool clamp = op == Operator::plus;
+
+    Color result;
+    result.a = clamp ? Min( sa + da, 1.0 ) : sa + da;
+    if( result.a <= 0 )
+        return Color( 0, 0, 0, 0 );
+
+    // Premultiplied sum is divided by the resulting alpha
+    auto channel = [&]( double s, double d )
+    {
+        auto c = s * sa + d * da;
+        return ( clamp ? Min( c, 1.0 ) : c ) / result.a;
+    };
+    result.r = channel( source.r, destination.r );
+    result.g = channel( source.g, destination.g );
+    result.b = channel( source.b, destination.b );
+    return result;
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ImageDataBase.h"
+
+// Compositing of premultiplied pixels with integer arithmetic
+namespace Composite
+{
+// Porter-Duff operators, result is source op destination
+enum class Operator
+{
+    clear,
+    source,
+    destination,
+    over,
+    destinationOver,
+    in,
+    destinationIn,
+    out,
+    destinationOut,
+    atop,
+    destinationAtop,
+    exclusiveOr,
+    plus
+};
+
+// Separable blend modes of source over destination
+enum class Blend
+{
+    normal,
+    multiply,
+    screen,
+    overlay,
+    add
+};
+
+// 16 bits per channel in the same order as Pixel
+class Pixel16
+{
+public:
+    uint16_t b, g, r, a;
+
+    Pixel16() : b( 0 ), g( 0 ), r( 0 ), a( 0 )
+    {}
+
+    Pixel16( uint16_t red, uint16_t green, uint16_t blue, uint16_t alpha = 65535 ) : b( blue ), g( green ), r( red ), a( alpha )
+    {}
+
+    explicit Pixel16( const Pixel &p );
+    explicit operator const Pixel() const;
+};
+
+Pixel premultiply( const Pixel &p );
+Pixel unpremultiply( const Pixel &p );
+Pixel16 premultiply( const Pixel16 &p );
+Pixel16 unpremultiply( const Pixel16 &p );
+
+// Rows of premultiplied pixels, results replace destination
+void row( Operator op, const Pixel *source, Pixel *destination, int count );
+void row( Operator op, const Pixel16 *source, Pixel16 *destination, int count );
+void row( Blend mode, const Pixel *source, Pixel *destination, int count );
+void row( Blend mode, const Pixel16 *source, Pixel16 *destination, int count );
+
+// Images with straight alpha, source is placed at x, y and only the area it covers is changed
+void compose( const ImageDataBase &source, ImageDataBase &destination, int x, int y, Operator op = Operator::over );
+void compose( const ImageDataBase &source, ImageDataBase &destination, int x, int y, Blend mode );
+
+// Colors with straight alpha through premultiplied arithmetic
+Color compose( Operator op, const Color &source, const Color &destination );
+}
@@ -0,0 +1,204 @@
+#include "DeepImage.h"
+
+#include <type_traits>
+#include <algorithm>
+#include <fstream>
+
+#include "Image/Translate.h"
+#include "Basic.h"
+
+#include "Raw.h"
+
+PixelF::PixelF( const Pixel &p ) : b( p.b / 255.0f ), g( p.g / 255.0f ), r( p.r / 255.0f ), a( p.a / 255.0f )
+{}
+
+PixelF::PixelF( const Composite::Pixel16 &p ) : b( p.b / 65535.0f ), g( p.g / 65535.0f ), r( p.r / 65535.0f ), a( p.a / 65535.0f )
+{}
+
+PixelF::operator const Pixel() const
+{
+    auto channel = []( float v )
+    {
+        return ( unsigned char )( Min( Max( v, 0.0f ), 1.0f ) * 255 + 0.5f );
+    };
+    return Pixel( channel( r ), channel( g ), channel( b ), channel( a ) );
+}
+
+PixelF::operator const Composite::Pixel16() const
+{
+    auto channel = []( float v )
+    {
+        return ( uint16_t )( Min( Max( v, 0.0f ), 1.0f ) * 65535 + 0.5f );
+    };
+    return Composite::Pixel16( channel( r ), channel( g ), channel( b ), channel( a ) );
+}
+
+template<typename P>
+DeepImage<P>::DeepImage()
+{}
+
+template<typename P>
+DeepImage<P>::DeepImage( int w, int h )
+{
+    this->reset( w, h );
+}
+
+template<typename P>
+void DeepImage<P>::from( const ImageDataBase &image )
+{
+    int w = image.w(), h = image.h();
+    this->reset( w, h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = image( 0, i );
+            auto o = ( *this )( 0, i );
+            for( int j = 0; j < w; ++j )
+                o[j] = P( p[j] );
+        }
+    } );
+}
+
+template<typename P>
+void DeepImage<P>::to( ImageDataBase &image ) const
+{
+    int w = this->w(), h = this->h();
+    image.reset( w, h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = ( *this )( 0, i );
+            auto o = image( 0, i );
+            for( int j = 0; j < w; ++j )
+                o[j] = ( Pixel )p[j];
+        }
+    } );
+}
+
+// Same layout as 8 bit references, every channel takes 16 bits
+static void makeReference( Image16 &image, ImageConvert::Reference &reference )
+{
+    reference.reset = [&image]( ImageConvert::Reference & ref )
+    {
+        image.reset( Abs( ref.w ), ref.h );
+        ref.link = image.rawData()[0];
+        return image.w() * image.h() * sizeof( Composite::Pixel16 ) >= ref.bytes;
+    };
+    reference.format = "B16G16R16A16*REPBG*REPRG*REPA65535";
+    reference.bytes = image.w() * image.h() * sizeof( Composite::Pixel16 );
+    reference.link = image.rawData()[0];
+    reference.w = image.w();
+    reference.h = image.h() * Sign( image.s() );
+}
+
+static bool read( Image16 &self, const std::filesystem::path &path )
+{
+    try
+    {
+        std::ifstream file( path, std::ios::binary );
+        if( !file )
+            return false;
+
+        file.seekg( 0, std::ios::end );
+        auto size = ( size_t )file.tellg();
+        file.seekg( 0, std::ios::beg );
+
+        ImageConvert::Reference image;
+        image.fill();
+        image.format = ".ANYF";
+        image.bytes = size;
+        image.reset( image );
+
+        if( !file.read( ( char * )image.link, size ) )
+            return false;
+        file.close();
+
+        ImageConvert::Reference reference;
+        makeReference( self, reference );
+
+        translate( image, reference, false );
+
+        if( self.setStride( false ) )
+            self.flipY( self );
+
+        return true;
+    }
+    catch( ... )
+    {}
+    return false;
+}
+
+static bool write( const Image16 &self, const std::filesystem::path &path )
+{
+    try
+    {
+        auto ext = path.extension().string();
+        std::transform( ext.begin(), ext.end(), ext.begin(), []( char c )
+        {
+            return std::toupper( c );
+        } );
+
+        ImageConvert::Reference image;
+        image.fill();
+        image.format = ext;
+
+        ImageConvert::Reference reference;
+        makeReference( const_cast<Image16 &>( self ), reference );
+
+        translate( reference, image, false );
+
+        std::filesystem::create_directories( path.parent_path() );
+        std::ofstream file( path, std::ios::binary );
+        if( !file )
+            return false;
+        if( !file.write( ( char * )image.link, image.bytes ) )
+            return false;
+        return true;
+    }
+    catch( ... )
+    {}
+    return false;
+}
+
+template<typename P>
+bool DeepImage<P>::input( const std::filesystem::path &path )
+{
+    if( Raw::matches( path ) )
+        return Raw::read( path, *this );
+
+    if constexpr( std::is_same_v<P, Composite::Pixel16> )
+    {
+        return read( *this, path );
+    }
+    else
+    {
+        Image16 image;
+        if( !read( image, path ) )
+            return false;
+        from( image );
+        return true;
+    }
+}
+
+template<typename P>
+bool DeepImage<P>::output( const std::filesystem::path &path ) const
+{
+    if( Raw::matches( path ) )
+        return Raw::write( path, *this );
+
+    if constexpr( std::is_same_v<P, Composite::Pixel16> )
+    {
+        return write( *this, path );
+    }
+    else
+    {
+        Image16 image;
+        image.from( *this );
+        return write( image, path );
+    }
+}
+
+template class DeepImage<Composite::Pixel16>;
+template class DeepImage<PixelF>;
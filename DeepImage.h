@@ -0,0 +1,66 @@
+#pragma once
+
+#include <filesystem>
+
+#include "ImageDataBase.h"
+#include "Composite.h"
+
+// 32 bit float channels in the same order as Pixel, 1 is full intensity, values outside of [0, 1] are kept
+class PixelF
+{
+public:
+    float b, g, r, a;
+
+    PixelF() : b( 0 ), g( 0 ), r( 0 ), a( 1 )
+    {}
+
+    PixelF( float red, float green, float blue, float alpha = 1 ) : b( blue ), g( green ), r( red ), a( alpha )
+    {}
+
+    explicit PixelF( const Pixel &p );
+    explicit PixelF( const Composite::Pixel16 &p );
+
+    // Quantization clamps to [0, 1]
+    explicit operator const Pixel() const;
+    explicit operator const Composite::Pixel16() const;
+};
+
+// Images with 16 bit or float channels, so chains of operations quantize only at export
+template<typename P>
+class DeepImage : public MatrixBase<P>
+{
+public:
+    DeepImage();
+    DeepImage( int w, int h );
+
+    void from( const ImageDataBase &image );
+    void to( ImageDataBase &image ) const;
+
+    template<typename Q>
+    void from( const DeepImage<Q> &image );
+
+    // Raw files keep channels as they are, others go through translate with 16 bits per channel
+    bool input( const std::filesystem::path &path );
+    bool output( const std::filesystem::path &path ) const;
+};
+
+using Image16 = DeepImage<Composite::Pixel16>;
+using ImageF = DeepImage<PixelF>;
+
+template<typename P>
+template<typename Q>
+void DeepImage<P>::from( const DeepImage<Q> &image )
+{
+    int w = image.w(), h = image.h();
+    this->reset( w, h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = image( 0, i );
+            auto o = ( *this )( 0, i );
+            for( int j = 0; j < w; ++j )
+                o[j] = ( P )p[j];
+        }
+    } );
+}
@@ -0,0 +1,183 @@
+#include "Distance.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Exception.h"
+#include "Basic.h"
+
+namespace Distance
+{
+void squared( const MatrixBase<unsigned char> &mask, MatrixBase<float> &out )
+{
+    int w = mask.w(), h = mask.h();
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    // Distances along columns, swept down and up a stripe of columns at once
+    MatrixBase<int> column;
+    column.reset( w, h );
+    const int none = w + h;
+
+    Parallel::rows( w, [&]( int begin, int end )
+    {
+        for( int i = 0; i < h; ++i )
+        {
+            auto m = mask( 0, i );
+            auto c = column( 0, i );
+            auto above = i > 0 ? column( 0, i - 1 ) : nullptr;
+            for( int j = begin; j < end; ++j )
+                c[j] = m[j] ? 0 : above ? Min( above[j] + 1, none ) : none;
+        }
+
+        for( int i = h - 2; i >= 0; --i )
+        {
+            auto c = column( 0, i );
+            auto below = column( 0, i + 1 );
+            for( int j = begin; j < end; ++j )
+                c[j] = Min( c[j], below[j] + 1 );
+        }
+    } );
+
+    out.reset( w, h );
+
+    // Lower envelope of parabolas rooted at cells with finite column distances
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        std::vector<int> v( w );
+        std::vector<double> f( w ), z( w + 1 );
+
+        for( int i = begin; i < end; ++i )
+        {
+            auto c = column( 0, i );
+            auto o = out( 0, i );
+
+            for( int j = 0; j < w; ++j )
+                f[j] = c[j] >= none ? infinity : ( double )c[j] * c[j];
+
+            int k = -1;
+            for( int q = 0; q < w; ++q )
+            {
+                if( c[q] >= none )
+                    continue;
+
+                double s = -infinity;
+                while( k >= 0 )
+                {
+                    s = ( ( f[q] + ( double )q * q ) - ( f[v[k]] + ( double )v[k] * v[k] ) ) / ( 2.0 * q - 2.0 * v[k] );
+                    if( s > z[k] )
+                        break;
+                    --k;
+                }
+
+                ++k;
+                v[k] = q;
+                z[k] = k ? s : -infinity;
+                z[k + 1] = infinity;
+            }
+
+            if( k < 0 )
+            {
+                std::fill( o, o + w, infinity );
+                continue;
+            }
+
+            k = 0;
+            for( int q = 0; q < w; ++q )
+            {
+                while( z[k + 1] < q )
+                    ++k;
+                o[q] = ( float )( ( double )( q - v[k] ) * ( q - v[k] ) + f[v[k]] );
+            }
+        }
+    } );
+}
+
+void euclidean( const MatrixBase<unsigned char> &mask, MatrixBase<float> &out )
+{
+    squared( mask, out );
+
+    Parallel::rows( out.h(), [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto o = out( 0, i );
+            for( int j = 0; j < out.w(); ++j )
+                o[j] = std::sqrt( o[j] );
+        }
+    } );
+}
+
+void field( const MatrixBase<unsigned char> &mask, MatrixBase<float> &out )
+{
+    int w = mask.w(), h = mask.h();
+
+    MatrixBase<unsigned char> inverse;
+    inverse.reset( w, h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto m = mask( 0, i );
+            auto n = inverse( 0, i );
+            for( int j = 0; j < w; ++j )
+                n[j] = !m[j];
+        }
+    } );
+
+    MatrixBase<float> inside;
+    squared( mask, out );
+    squared( inverse, inside );
+
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto m = mask( 0, i );
+            auto o = out( 0, i );
+            auto n = inside( 0, i );
+            for( int j = 0; j < w; ++j )
+                o[j] = m[j] ? 0.5f - std::sqrt( n[j] ) : std::sqrt( o[j] ) - 0.5f;
+        }
+    } );
+}
+
+void field( const ImageDataBase &in, ImageDataBase &out, const Regions::Key &key, double spread )
+{
+    makeException( spread > 0 );
+
+    int w = in.w(), h = in.h();
+
+    MatrixBase<unsigned char> mask;
+    mask.reset( w, h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = in( 0, i );
+            auto m = mask( 0, i );
+            for( int j = 0; j < w; ++j )
+                m[j] = key( p[j] );
+        }
+    } );
+
+    MatrixBase<float> distance;
+    field( mask, distance );
+
+    out.reset( w, h );
+    float scale = ( float )( 127.5 / spread );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto d = distance( 0, i );
+            auto o = out( 0, i );
+            for( int j = 0; j < w; ++j )
+            {
+                auto v = ( unsigned char )Min( Max( 128 - d[j] * scale, 0.0f ), 255.0f );
+                o[j] = Pixel( v, v, v );
+            }
+        }
+    } );
+}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ImageDataBase.h"
+#include "Regions.h"
+
+namespace Distance
+{
+// Squared Euclidean distance from every cell to the nearest non-zero cell of the mask, infinity without any
+// Distances along columns are swept, then lower envelopes of parabolas are taken along rows (Felzenszwalb and Huttenlocher)
+void squared( const MatrixBase<unsigned char> &mask, MatrixBase<float> &out );
+
+void euclidean( const MatrixBase<unsigned char> &mask, MatrixBase<float> &out );
+
+// Negative inside of the mask and positive outside, zero halfway between centres of border cells
+void field( const MatrixBase<unsigned char> &mask, MatrixBase<float> &out );
+
+// Gray field of pixels selected by key for glyph atlases and bevels,
+// 128 on the border, white spread pixels inside and black spread pixels outside
+void field( const ImageDataBase &in, ImageDataBase &out, const Regions::Key &key, double spread );
+}
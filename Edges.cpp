@@ -0,0 +1,202 @@
+#include "Edges.h"
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#include "Exception.h"
+#include "Basic.h"
+
+namespace Edges
+{
+Gradient::Gradient( const ImageDataBase &image )
+{
+    int width = image.w(), height = image.h();
+
+    magnitude.reset( width, height );
+    direction.reset( width, height );
+    if( width <= 0 || height <= 0 )
+        return;
+
+    // Sum of channels of a row with one extended pixel on both sides
+    auto sum = [&]( int i, std::vector<int> &s )
+    {
+        auto p = image( 0, Min( Max( i, 0 ), height - 1 ) );
+        for( int j = 0; j < width; ++j )
+            s[j + 1] = p[j].r + p[j].g + p[j].b;
+        s[0] = s[1];
+        s[width + 1] = s[width];
+    };
+
+    const float scale = 1.0f / ( 4 * 3 * 255 );
+
+    Parallel::rows( height, [&]( int begin, int end )
+    {
+        std::vector<int> above( width + 2 ), row( width + 2 ), below( width + 2 );
+        sum( begin - 1, above );
+        sum( begin, row );
+
+        for( int i = begin; i < end; ++i )
+        {
+            sum( i + 1, below );
+
+            auto m = magnitude( 0, i );
+            auto d = direction( 0, i );
+            for( int j = 0; j < width; ++j )
+            {
+                int gx = ( above[j + 2] + 2 * row[j + 2] + below[j + 2] ) - ( above[j] + 2 * row[j] + below[j] );
+                int gy = ( below[j] + 2 * below[j + 1] + below[j + 2] ) - ( above[j] + 2 * above[j + 1] + above[j + 2] );
+
+                m[j] = std::sqrt( ( float )( gx * gx + gy * gy ) ) * scale;
+
+                // Sectors are split at tangents of 22.5 and 67.5 degrees
+                int ax = gx < 0 ? -gx : gx;
+                int ay = gy < 0 ? -gy : gy;
+                if( ay * 1000 <= ax * 414 )
+                    d[j] = 0;
+                else if( ay * 414 >= ax * 1000 )
+                    d[j] = 2;
+                else
+                    d[j] = ( gx > 0 ) == ( gy > 0 ) ? 1 : 3;
+            }
+
+            above.swap( row );
+            row.swap( below );
+        }
+    } );
+}
+
+int Gradient::w() const
+{
+    return magnitude.w();
+}
+
+int Gradient::h() const
+{
+    return magnitude.h();
+}
+
+void magnitude( const ImageDataBase &in, ImageDataBase &out )
+{
+    Gradient gradient( in );
+    int w = gradient.w(), h = gradient.h();
+
+    std::mutex mutex;
+    float maximum = 0;
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        float m = 0;
+        for( int i = begin; i < end; ++i )
+        {
+            auto g = gradient.magnitude( 0, i );
+            for( int j = 0; j < w; ++j )
+                m = Max( m, g[j] );
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+        maximum = Max( maximum, m );
+    } );
+
+    float scale = maximum > 0 ? 255 / maximum : 0;
+
+    out.reset( w, h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto g = gradient.magnitude( 0, i );
+            auto o = out( 0, i );
+            for( int j = 0; j < w; ++j )
+            {
+                auto v = ( unsigned char )( g[j] * scale + 0.5f );
+                o[j] = Pixel( v, v, v );
+            }
+        }
+    } );
+}
+
+void canny( const ImageDataBase &in, ImageDataBase &out, double low, double high )
+{
+    makeException( 0 <= low && low <= high );
+
+    Gradient gradient( in );
+    int w = gradient.w(), h = gradient.h();
+
+    // 0 is suppressed, 1 is weak, 2 is strong
+    enum : unsigned char
+    {
+        none,
+        weak,
+        strong
+    };
+
+    std::vector<unsigned char> edges( ( size_t )w * h, none );
+
+    // Neighbours along the gradient for every direction
+    const int dx[4] = { 1, 1, 0, 1 };
+    const int dy[4] = { 0, 1, 1, -1 };
+
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto m = gradient.magnitude( 0, i );
+            auto d = gradient.direction( 0, i );
+            auto e = &edges[( size_t )i * w];
+            for( int j = 0; j < w; ++j )
+            {
+                if( m[j] < low )
+                    continue;
+
+                int x = dx[d[j]], y = dy[d[j]];
+                auto n0 = *gradient.magnitude( Min( Max( j + x, 0 ), w - 1 ), Min( Max( i + y, 0 ), h - 1 ) );
+                auto n1 = *gradient.magnitude( Min( Max( j - x, 0 ), w - 1 ), Min( Max( i - y, 0 ), h - 1 ) );
+
+                // Ties go to one side only, so plateaus stay one pixel thin
+                if( m[j] > n0 && m[j] >= n1 )
+                    e[j] = m[j] >= high ? strong : weak;
+            }
+        }
+    } );
+
+    // Weak edges connected to strong ones are kept
+    std::vector<size_t> stack;
+    for( size_t k = 0; k < edges.size(); ++k )
+    {
+        if( edges[k] == strong )
+            stack.push_back( k );
+    }
+
+    while( !stack.empty() )
+    {
+        auto k = stack.back();
+        stack.pop_back();
+
+        int i = ( int )( k / w ), j = ( int )( k % w );
+        for( int y = Max( i - 1, 0 ); y <= Min( i + 1, h - 1 ); ++y )
+        {
+            for( int x = Max( j - 1, 0 ); x <= Min( j + 1, w - 1 ); ++x )
+            {
+                auto &e = edges[( size_t )y * w + x];
+                if( e == weak )
+                {
+                    e = strong;
+                    stack.push_back( ( size_t )y * w + x );
+                }
+            }
+        }
+    }
+
+    out.reset( w, h );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto e = &edges[( size_t )i * w];
+            auto o = out( 0, i );
+            for( int j = 0; j < w; ++j )
+                o[j] = e[j] == strong ? Pixel( 255, 255, 255 ) : Pixel( 0, 0, 0 );
+        }
+    } );
+}
+}
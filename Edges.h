@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ImageDataBase.h"
+
+namespace Edges
+{
+// Sobel of the mean of r, g and b in a single pass, borders are extended
+// Magnitude is 1 for a full step from black to white,
+// direction of the gradient is quantized to 0 horizontal, 1 diagonal down, 2 vertical, 3 diagonal up
+class Gradient
+{
+public:
+    MatrixBase<float> magnitude;
+    MatrixBase<unsigned char> direction;
+
+    Gradient( const ImageDataBase &image );
+
+    int w() const;
+    int h() const;
+};
+
+// Gray magnitude stretched to the full range
+void magnitude( const ImageDataBase &in, ImageDataBase &out );
+
+// Non-maximum suppression of the gradient and hysteresis between thresholds, edges are white on black
+void canny( const ImageDataBase &in, ImageDataBase &out, double low = 0.1, double high = 0.25 );
+}
@@ -1,15 +1,16 @@
 #include "Filters.h"
 
+#include <limits>
+#include <memory>
+#include <mutex>
+
 #include "MatrixArithmetic.h"
 #include "Exception.h"
 #include "Basic.h"
 
-// https://en.wikipedia.org/wiki/Kernel_(image_processing)
+#include "ImageData.h"
 
-static double randMult()
-{
-    return Filters::randomNumber.getReal( 0.8, 1 );
-}
+// https://en.wikipedia.org/wiki/Kernel_(image_processing)
 
 static double fiveSectorsBase( double x )
 {
@@ -75,11 +76,12 @@ void Filters::gray( double, double, Color w, Color &z )
     z.a = w.a;
 }
 
-void Filters::noize( double, double, Color w, Color &z )
+void Filters::noize( double x, double y, Color w, Color &z )
 {
-    z.r = w.r * randMult();
-    z.g = w.g * randMult();
-    z.b = w.b * randMult();
+    auto random = randomStream.point( x, y );
+    z.r = w.r * random.getReal( 0.8, 1 );
+    z.g = w.g * random.getReal( 0.8, 1 );
+    z.b = w.b * random.getReal( 0.8, 1 );
     z.a = w.a;
 }
 
@@ -131,6 +133,8 @@ Filters::Convolution::Convolution()
     *k( 0, 0 ) = B4( 1 );
     border = Border::extend;
     alpha = true;
+    range = Range::normalize;
+    memory = ( size_t )256 << 20;
 }
 
 void Filters::Convolution::outline( bool horizontal )
@@ -336,61 +340,847 @@ void Filters::Convolution::checkerboard()
     alpha = true;
 }
 
+// Source index for an index outside of [0, size), -1 means a constant value
+static int borderIndex( Filters::Border border, int k, int size )
+{
+    if( 0 <= k && k < size )
+        return k;
+
+    switch( border )
+    {
+    case Filters::Border::extend:
+        return k < 0 ? 0 : size - 1;
+    case Filters::Border::wrap:
+        return ( k % size + size ) % size;
+    case Filters::Border::mirror:
+    {
+        int m = ( k % size + size ) % size;
+        return ( ( k - m ) / size ) % 2 ? size - m - 1 : m;
+    }
+    case Filters::Border::crop:
+    case Filters::Border::cropKernel:
+    case Filters::Border::constant:
+        return -1;
+    default:
+        makeException( false );
+        break;
+    }
+    return -1;
+}
+
+// Weights of the kernel as MatrixArithmetic applies it, probed with an impulse,
+// weight ( b, a ) multiplies input ( j + b, i + a ) of output ( j, i )
+static std::vector<double> probeKernel( const MatrixBase<B4> &kernel )
+{
+    int kw = kernel.w(), kh = kernel.h();
+
+    MatrixArithmetic<B4> impulse;
+    impulse.reset( 2 * kw - 1, 2 * kh - 1 );
+    *impulse( kw - 1, kh - 1 ) = B4( 1 );
+
+    auto response = impulse.convolution( MatrixArithmetic<B4>( kernel ) );
+
+    std::vector<double> weights( ( size_t )kw * kh * 4 );
+    for( int a = 0; a < kh; ++a )
+    {
+        for( int b = 0; b < kw; ++b )
+        {
+            auto &r = *response( kw - 1 - b, kh - 1 - a );
+            auto o = &weights[( ( size_t )a * kw + b ) * 4];
+            o[0] = ( double )r.x;
+            o[1] = ( double )r.y;
+            o[2] = ( double )r.z;
+            o[3] = ( double )r.w;
+        }
+    }
+    return weights;
+}
+
+static void channels( const Pixel &p, double *o )
+{
+    o[0] = p.r / 255.0;
+    o[1] = p.g / 255.0;
+    o[2] = p.b / 255.0;
+    o[3] = p.a / 255.0;
+}
+
+static void channels( const PixelF &p, double *o )
+{
+    o[0] = p.r;
+    o[1] = p.g;
+    o[2] = p.b;
+    o[3] = p.a;
+}
+
+static void store( const double *v, Pixel &p )
+{
+    p = ( Pixel )Color( v[0], v[1], v[2], v[3] );
+}
+
+static void store( const double *v, PixelF &p )
+{
+    p = PixelF( ( float )v[0], ( float )v[1], ( float )v[2], ( float )v[3] );
+}
+
+// Output rows of a convolution are passed to visit( i, row ) with 4 values per pixel as soon as they are computed,
+// every band of rows keeps a ring of kernel.h() padded input rows, so memory is proportional to width and kernel height,
+// row y of the w x h input comes from rows( y, scratch ), which either returns a row of an image or fills scratch
+template<typename P, typename Rows, typename Visit>
+static void streamConvolution( const Filters::Convolution &params, int w, int h, const Rows &rows, const std::vector<double> &weights, Visit visit )
+{
+    int kw = params.kernel.w(), kh = params.kernel.h();
+
+    bool crop = params.border == Filters::Border::crop;
+    int left = crop ? 0 : ( int )Round( ( kw - 1 ) * 0.5 );
+    int top = crop ? 0 : ( int )Round( ( kh - 1 ) * 0.5 );
+    int ow = crop ? w - kw + 1 : w;
+    int oh = crop ? h - kh + 1 : h;
+    int pw = ow + kw - 1;
+
+    auto constant = params.border == Filters::Border::cropKernel ? B4() : params.constant;
+    double fill[4] = { ( double )constant.x, ( double )constant.y, ( double )constant.z, ( double )constant.w };
+
+    std::vector<int> columns( pw );
+    for( int j = 0; j < pw; ++j )
+        columns[j] = crop ? j : borderIndex( params.border, j - left, w );
+
+    // Taps with zero weights in every channel are skipped
+    std::vector<char> zero( ( size_t )kw * kh );
+    for( size_t t = 0; t < zero.size(); ++t )
+    {
+        auto k = &weights[t * 4];
+        zero[t] = Abs( k[0] ) + Abs( k[1] ) + Abs( k[2] ) + Abs( k[3] ) <= 0;
+    }
+
+    Parallel::rows( oh, [&]( int begin, int end )
+    {
+        std::vector<double> ring( ( size_t )kh * pw * 4 ), row( ( size_t )ow * 4 );
+        std::vector<P> scratch( w );
+
+        // Padded row p goes to slot p % kh
+        auto load = [&]( int p )
+        {
+            auto o = &ring[( size_t )( p % kh ) * pw * 4];
+            int y = crop ? p : borderIndex( params.border, p - top, h );
+            const P *source = y < 0 ? nullptr : rows( y, scratch.data() );
+            for( int j = 0; j < pw; ++j, o += 4 )
+            {
+                int x = columns[j];
+                if( !source || x < 0 )
+                {
+                    std::copy( fill, fill + 4, o );
+                    continue;
+                }
+                channels( source[x], o );
+            }
+        };
+
+        for( int p = begin; p < begin + kh - 1; ++p )
+            load( p );
+
+        for( int i = begin; i < end; ++i )
+        {
+            load( i + kh - 1 );
+
+            std::fill( row.begin(), row.end(), 0.0 );
+            for( int a = 0; a < kh; ++a )
+            {
+                auto r = &ring[( size_t )( ( i + a ) % kh ) * pw * 4];
+                for( int b = 0; b < kw; ++b )
+                {
+                    if( zero[( size_t )a * kw + b] )
+                        continue;
+
+                    auto k = &weights[( ( size_t )a * kw + b ) * 4];
+
+                    auto x = r + b * 4;
+                    for( int j = 0; j < ow * 4; j += 4 )
+                    {
+                        row[j] += k[0] * x[j];
+                        row[j + 1] += k[1] * x[j + 1];
+                        row[j + 2] += k[2] * x[j + 2];
+                        row[j + 3] += k[3] * x[j + 3];
+                    }
+                }
+            }
+
+            visit( i, row.data() );
+        }
+    } );
+}
+
+template<typename P, typename Image, typename Rows>
+static void convolve( const Filters::Convolution &params, int w, int h, const Rows &rows, Image &out )
+{
+    using Range = Filters::Range;
+
+    int kw = params.kernel.w(), kh = params.kernel.h();
+    makeException( kw > 0 && kh > 0 );
+
+    bool crop = params.border == Filters::Border::crop;
+    int ow = crop ? w - kw + 1 : w;
+    int oh = crop ? h - kh + 1 : h;
+    if( ow <= 0 || oh <= 0 )
+    {
+        out.reset( Max( ow, 0 ), Max( oh, 0 ) );
+        return;
+    }
+
+    auto weights = probeKernel( params.kernel );
+
+    // Range of every channel, either of the kernel or of the whole result
+    double low[4] = {}, high[4] = {};
+    // Results to normalize are kept, when they fit in memory, larger ones are computed twice,
+    // both ways give the same pixels
+    std::vector<double> kept;
+    if( params.range == Range::normalize && ( size_t )ow * oh * 4 * sizeof( double ) <= params.memory )
+        kept.resize( ( size_t )ow * oh * 4 );
+
+    if( params.range == Range::normalize )
+    {
+        std::mutex mutex;
+        std::fill( low, low + 4, std::numeric_limits<double>::max() );
+        std::fill( high, high + 4, std::numeric_limits<double>::lowest() );
+        streamConvolution<P>( params, w, h, rows, weights, [&]( int i, const double * row )
+        {
+            if( !kept.empty() )
+                std::copy( row, row + ow * 4, kept.begin() + ( size_t )i * ow * 4 );
+
+            double l[4], u[4];
+            std::copy( row, row + 4, l );
+            std::copy( row, row + 4, u );
+            for( int j = 0; j < ow * 4; ++j )
+            {
+                l[j % 4] = Min( l[j % 4], row[j] );
+                u[j % 4] = Max( u[j % 4], row[j] );
+            }
+
+            std::lock_guard<std::mutex> lock( mutex );
+            for( int c = 0; c < 4; ++c )
+            {
+                low[c] = Min( low[c], l[c] );
+                high[c] = Max( high[c], u[c] );
+            }
+        } );
+    }
+    else if( params.range == Range::kernel )
+    {
+        for( size_t k = 0; k < weights.size(); ++k )
+            ( weights[k] < 0 ? low[k % 4] : high[k % 4] ) += weights[k];
+    }
+
+    auto map = [&]( double v, int c )
+    {
+        if( params.range == Range::clamp )
+            return Min( Max( v, 0.0 ), 1.0 );
+        return high[c] > low[c] ? Min( Max( ( v - low[c] ) / ( high[c] - low[c] ), 0.0 ), 1.0 ) : 0.0;
+    };
+
+    auto write = [&]( int i, const double * row )
+    {
+        auto o = out( 0, i );
+        for( int j = 0; j < ow; ++j, row += 4 )
+        {
+            double v[4] = { map( row[0], 0 ), map( row[1], 1 ), map( row[2], 2 ), params.alpha ? map( row[3], 3 ) : 1 };
+            store( v, o[j] );
+        }
+    };
+
+    out.reset( ow, oh );
+    if( kept.empty() )
+    {
+        streamConvolution<P>( params, w, h, rows, weights, write );
+        return;
+    }
+
+    Parallel::rows( oh, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+            write( i, &kept[( size_t )i * ow * 4] );
+    } );
+}
+
 void Filters::convolution( const Convolution &params, const ImageDataBase &in, ImageDataBase &out )
 {
-    using TransformIn = std::function<void( int, int, int, int, const Pixel &, B4 & )>;
-    using TransformOut = std::function<void( int, int, int, int, const B4 &, Pixel & )>;
+    if( static_cast<const ImageDataBase *>( &out ) == &in )
+    {
+        ImageData temporary;
+        convolution( params, in, temporary );
+        temporary.copy( out );
+        return;
+    }
 
-    MatrixArithmetic<B4> input, output;
+    convolve<Pixel>( params, in.w(), in.h(), [&]( int y, Pixel * )
+    {
+        return in( 0, y );
+    }, out );
+}
 
-    in.transform( input, ( TransformIn )[]( int, int, int, int, const Pixel & p, B4 & b )
+void Filters::convolution( const Convolution &params, int w, int h, const Rows &source, ImageDataBase &out )
+{
+    convolve<Pixel>( params, w, h, [&]( int y, Pixel * scratch )
     {
-        b = B4( ( long double )p.r / 255, ( long double )p.g / 255, ( long double )p.b / 255, ( long double )p.a / 255 );
+        source( y, scratch );
+        return ( const Pixel * )scratch;
+    }, out );
+}
+
+void Filters::convolution( const Convolution &params, const ImageF &in, ImageF &out )
+{
+    if( &out == &in )
+    {
+        ImageF temporary;
+        convolution( params, in, temporary );
+        temporary.copy( out );
+        return;
+    }
+
+    convolve<PixelF>( params, in.w(), in.h(), [&]( int y, PixelF * )
+    {
+        return in( 0, y );
+    }, out );
+}
+
+void Filters::normalize( const ImageDataBase &in, ImageDataBase &out, bool alpha )
+{
+    int w = in.w(), h = in.h();
+
+    // Minimum and maximum of every channel, collected per band and merged
+    std::mutex mutex;
+    int low[4] = { 255, 255, 255, 255 }, high[4] = { 0, 0, 0, 0 };
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        int l[4] = { 255, 255, 255, 255 }, u[4] = { 0, 0, 0, 0 };
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = in( 0, i );
+            for( int j = 0; j < w; ++j )
+            {
+                int v[4] = { p[j].r, p[j].g, p[j].b, p[j].a };
+                for( int c = 0; c < 4; ++c )
+                {
+                    l[c] = Min( l[c], v[c] );
+                    u[c] = Max( u[c], v[c] );
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+        for( int c = 0; c < 4; ++c )
+        {
+            low[c] = Min( low[c], l[c] );
+            high[c] = Max( high[c], u[c] );
+        }
     } );
 
-    switch( params.border )
+    unsigned char table[4][256];
+    for( int c = 0; c < 4; ++c )
     {
-    case Border::extend:
-        extend( input, params.kernel.w() - 1, params.kernel.h() - 1 );
-        break;
-    case Border::wrap:
-        wrap( input, params.kernel.w() - 1, params.kernel.h() - 1 );
-        break;
-    case Border::mirror:
-        mirror( input, params.kernel.w() - 1, params.kernel.h() - 1 );
-        break;
-    case Border::cropKernel:
-        constant( input, params.kernel.w() - 1, params.kernel.h() - 1, B4() );
-        break;
-    case Border::constant:
-        constant( input, params.kernel.w() - 1, params.kernel.h() - 1, params.constant );
-        break;
-    case Border::crop:
-        break;
-    default:
-        makeException( false );
-        break;
+        for( int v = 0; v < 256; ++v )
+        {
+            if( c == 3 && !alpha )
+                table[c][v] = ( unsigned char )v;
+            else
+                table[c][v] = high[c] > low[c] ? ( unsigned char )Round( ( Max( v, low[c] ) - low[c] ) * 255.0 / ( high[c] - low[c] ) ) : 0;
+        }
+    }
+
+    if( static_cast<const ImageDataBase *>( &out ) != &in && ( out.w() != w || out.h() != h ) )
+        out.reset( w, h );
+
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = in( 0, i );
+            auto o = out( 0, i );
+            for( int j = 0; j < w; ++j )
+                o[j] = Pixel( table[0][p[j].r], table[1][p[j].g], table[2][p[j].b], table[3][p[j].a] );
+        }
+    } );
+}
+
+Filters::Rank::Rank()
+{
+    median( 1 );
+}
+
+void Filters::Rank::median( int r )
+{
+    percentile( r, 0.5 );
+}
+
+void Filters::Rank::erode( int r )
+{
+    percentile( r, 0 );
+}
+
+void Filters::Rank::dilate( int r )
+{
+    percentile( r, 1 );
+}
+
+void Filters::Rank::percentile( int r, double p )
+{
+    radius = r;
+    rank = p;
+    border = Border::extend;
+    constant = Pixel( 0, 0, 0, 0 );
+    alpha = true;
+}
+
+void Filters::rank( const Rank &params, const ImageDataBase &in, ImageDataBase &out )
+{
+    makeException( params.radius >= 0 && 0 <= params.rank && params.rank <= 1 );
+
+    if( static_cast<const ImageDataBase *>( &out ) == &in )
+    {
+        ImageData temporary;
+        rank( params, in, temporary );
+        temporary.copy( out );
+        return;
+    }
+
+    int r = params.radius;
+    int size = 2 * r + 1;
+
+    // Crop only keeps pixels, which windows lie inside of the image
+    bool crop = params.border == Border::crop;
+    int offset = crop ? r : 0;
+    int w = crop ? in.w() - 2 * r : in.w();
+    int h = crop ? in.h() - 2 * r : in.h();
+    if( w <= 0 || h <= 0 )
+    {
+        out.reset( Max( w, 0 ), Max( h, 0 ) );
+        return;
+    }
+
+    auto constant = params.border == Border::cropKernel ? Pixel( 0, 0, 0, 0 ) : params.constant;
+
+    // Padded columns and rows of the window around output pixels
+    std::vector<int> columns( w + 2 * r ), rows( h + 2 * r );
+    for( int p = 0; p < w + 2 * r; ++p )
+        columns[p] = borderIndex( params.border, p + offset - r, in.w() );
+    for( int p = 0; p < h + 2 * r; ++p )
+        rows[p] = borderIndex( params.border, p + offset - r, in.h() );
+
+    uint32_t target = ( uint32_t )( params.rank * ( ( double )size * size - 1 ) );
+
+    out.reset( w, h );
+
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        // Histograms of every padded column over the rows of the window, 256 fine bins and 16 coarse
+        std::vector<uint16_t> fine( ( size_t )( w + 2 * r ) * 256 ), coarse( ( size_t )( w + 2 * r ) * 16 );
+        uint32_t kernelFine[256], kernelCoarse[16];
+
+        for( int c = 0; c < ( params.alpha ? 4 : 3 ); ++c )
+        {
+            auto value = [&]( int p, int row ) -> unsigned char
+            {
+                auto source = rows[row];
+                auto column = columns[p];
+                const Pixel &pixel = source < 0 || column < 0 ? constant : *in( column, source );
+                switch( c )
+                {
+                case 0:
+                    return pixel.r;
+                case 1:
+                    return pixel.g;
+                case 2:
+                    return pixel.b;
+                default:
+                    return pixel.a;
+                }
+            };
+
+            auto change = [&]( int p, int row, int delta )
+            {
+                auto v = value( p, row );
+                fine[( size_t )p * 256 + v] += delta;
+                coarse[( size_t )p * 16 + ( v >> 4 )] += delta;
+            };
+
+            std::fill( fine.begin(), fine.end(), 0 );
+            std::fill( coarse.begin(), coarse.end(), 0 );
+            for( int p = 0; p < w + 2 * r; ++p )
+            {
+                for( int row = begin; row < begin + size; ++row )
+                    change( p, row, 1 );
+            }
+
+            for( int i = begin; i < end; ++i )
+            {
+                if( i > begin )
+                {
+                    for( int p = 0; p < w + 2 * r; ++p )
+                    {
+                        change( p, i - 1, -1 );
+                        change( p, i + size - 1, 1 );
+                    }
+                }
+
+                std::fill( kernelFine, kernelFine + 256, 0 );
+                std::fill( kernelCoarse, kernelCoarse + 16, 0 );
+
+                auto add = [&]( int p, int sign )
+                {
+                    auto f = &fine[( size_t )p * 256];
+                    for( int k = 0; k < 256; ++k )
+                        kernelFine[k] += sign * f[k];
+
+                    auto g = &coarse[( size_t )p * 16];
+                    for( int k = 0; k < 16; ++k )
+                        kernelCoarse[k] += sign * g[k];
+                };
+
+                for( int p = 0; p < size; ++p )
+                    add( p, 1 );
+
+                auto o = out( 0, i );
+                for( int j = 0; j < w; ++j )
+                {
+                    if( j > 0 )
+                    {
+                        add( j - 1, -1 );
+                        add( j + size - 1, 1 );
+                    }
+
+                    uint32_t sum = 0;
+                    int bin = 0;
+                    while( sum + kernelCoarse[bin] <= target )
+                        sum += kernelCoarse[bin++];
+
+                    bin *= 16;
+                    while( sum + kernelFine[bin] <= target )
+                        sum += kernelFine[bin++];
+
+                    auto v = ( unsigned char )bin;
+                    switch( c )
+                    {
+                    case 0:
+                        o[j].r = v;
+                        break;
+                    case 1:
+                        o[j].g = v;
+                        break;
+                    case 2:
+                        o[j].b = v;
+                        break;
+                    default:
+                        o[j].a = v;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if( !params.alpha )
+        {
+            for( int i = begin; i < end; ++i )
+            {
+                auto o = out( 0, i );
+                for( int j = 0; j < w; ++j )
+                    o[j].a = 255;
+            }
+        }
+    } );
+}
+
+Filters::Blur::Blur()
+{
+    gaussian( 1 );
+}
+
+void Filters::Blur::box( int r )
+{
+    type = Type::box;
+    radius = r;
+    sigma = 0;
+    border = Border::mirror;
+    constant = Pixel( 0, 0, 0, 0 );
+    alpha = true;
+}
+
+void Filters::Blur::gaussian( double s )
+{
+    type = Type::gaussian;
+    radius = 0;
+    sigma = s;
+    border = Border::mirror;
+    constant = Pixel( 0, 0, 0, 0 );
+    alpha = true;
+}
+
+// Coefficients of the recursive Gaussian of Young and van Vliet, with the boundary matrix of Triggs and Sdika,
+// which maps the last three forward outputs minus the last input to the three backward states after the line
+class Recursive
+{
+public:
+    float b, b1, b2, b3;
+    double boundary[9];
+
+    explicit Recursive( double s );
+};
+
+Recursive::Recursive( double s )
+{
+    double q = s >= 2.5 ? 0.98711 * s - 0.96330 : 3.97156 - 4.14554 * Sqrt( 1 - 0.26891 * s );
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+    b1 = ( 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q ) / b0;
+    b2 = -( 1.4281 * q * q + 1.26661 * q * q * q ) / b0;
+    b3 = 0.422205 * q * q * q / b0;
+    b = 1 - ( b1 + b2 + b3 );
+
+    // The matrix is linear in the residuals, so its columns are responses to unit residuals:
+    // the forward filter runs on without input until the residual decays, then the backward filter runs back to the line
+    int length = ( int )RoundUp( 20 * s ) + 64;
+    std::vector<double> forward( length );
+    for( int e = 0; e < 3; ++e )
+    {
+        double w1 = e == 0 ? 1 : 0, w2 = e == 1 ? 1 : 0, w3 = e == 2 ? 1 : 0;
+        for( int n = 0; n < length; ++n )
+        {
+            forward[n] = b1 * w1 + b2 * w2 + b3 * w3;
+            w3 = w2;
+            w2 = w1;
+            w1 = forward[n];
+        }
+
+        double y1 = 0, y2 = 0, y3 = 0;
+        for( int n = length - 1; n >= 0; --n )
+        {
+            double y = b * forward[n] + b1 * y1 + b2 * y2 + b3 * y3;
+            y3 = y2;
+            y2 = y1;
+            y1 = y;
+            if( n < 3 )
+                boundary[n * 3 + e] = y;
+        }
+    }
+}
+
+// Filters count consecutive vectors of width floats
+// Recursive is used for wide Gaussians only
+static void blurLine( const Filters::Blur &params, const Recursive *recursive, float *data, int count, int width, std::vector<float> &temporary )
+{
+    if( params.type == Filters::Blur::Type::box )
+    {
+        int r = params.radius;
+        if( r <= 0 )
+            return;
+
+        temporary.assign( ( size_t )count * width, 0.0f );
+
+        std::vector<float> sum( width, 0.0f );
+        for( int k = 0; k < 2 * r + 1 && k < count; ++k )
+        {
+            for( int c = 0; c < width; ++c )
+                sum[c] += data[( size_t )k * width + c];
+        }
+
+        float scale = 1.0f / ( 2 * r + 1 );
+        for( int k = r; k + r < count; ++k )
+        {
+            auto o = &temporary[( size_t )k * width];
+            for( int c = 0; c < width; ++c )
+                o[c] = sum[c] * scale;
+
+            if( k + r + 1 < count )
+            {
+                auto add = &data[( size_t )( k + r + 1 ) * width];
+                auto remove = &data[( size_t )( k - r ) * width];
+                for( int c = 0; c < width; ++c )
+                    sum[c] += add[c] - remove[c];
+            }
+        }
+
+        std::copy( temporary.begin(), temporary.end(), data );
+        return;
     }
 
-    output = input.convolution( MatrixArithmetic<B4>( params.kernel ) );
+    double s = params.sigma;
+    if( s < 0.5 || count < 4 )
+        return;
+
+    // Recursive approximation is poor for narrow kernels, which are cheap to apply directly
+    if( s < 3 )
+    {
+        int r = ( int )RoundUp( 3 * s );
+        std::vector<float> kernel( 2 * r + 1 );
+        double total = 0;
+        for( int t = -r; t <= r; ++t )
+            total += kernel[t + r] = Exp( -t * t / ( 2 * s * s ) );
+        for( auto &k : kernel )
+            k /= total;
+
+        temporary.assign( ( size_t )count * width, 0.0f );
+        for( int k = r; k + r < count; ++k )
+        {
+            auto o = &temporary[( size_t )k * width];
+            for( int t = -r; t <= r; ++t )
+            {
+                auto x = &data[( size_t )( k + t ) * width];
+                for( int c = 0; c < width; ++c )
+                    o[c] += kernel[t + r] * x[c];
+            }
+        }
+
+        std::copy( temporary.begin(), temporary.end(), data );
+        return;
+    }
+
+    auto &r = *recursive;
+    float b = r.b, b1 = r.b1, b2 = r.b2, b3 = r.b3;
+
+    // First and last input values, the signal is taken as constant beyond both ends
+    temporary.resize( ( size_t )5 * width );
+    auto first = temporary.data(), last = first + width, after = last + width;
+    std::copy( data, data + width, first );
+    std::copy( data + ( size_t )( count - 1 ) * width, data + ( size_t )count * width, last );
 
-    Interval<long double> x, y, z, w;
-    output.transform( out, ( TransformOut )[&]( int, int, int, int, const B4 & b, Pixel & )
+    // Forward filter starts in the steady state of the first value
+    for( int k = 0; k < count; ++k )
     {
-        x.add( b.x );
-        y.add( b.y );
-        z.add( b.z );
-        w.add( b.w );
+        auto x = &data[( size_t )k * width];
+        auto p1 = k >= 1 ? &data[( size_t )( k - 1 ) * width] : first;
+        auto p2 = k >= 2 ? &data[( size_t )( k - 2 ) * width] : first;
+        auto p3 = k >= 3 ? &data[( size_t )( k - 3 ) * width] : first;
+        for( int c = 0; c < width; ++c )
+            x[c] = b * x[c] + b1 * p1[c] + b2 * p2[c] + b3 * p3[c];
+    }
+
+    // Backward filter starts in the states, which running both filters on past the end would reach
+    auto w1 = &data[( size_t )( count - 1 ) * width];
+    auto w2 = &data[( size_t )( count - 2 ) * width];
+    auto w3 = &data[( size_t )( count - 3 ) * width];
+    for( int c = 0; c < width; ++c )
+    {
+        double d1 = w1[c] - last[c], d2 = w2[c] - last[c], d3 = w3[c] - last[c];
+        for( int n = 0; n < 3; ++n )
+            after[n * width + c] = last[c] + r.boundary[n * 3] * d1 + r.boundary[n * 3 + 1] * d2 + r.boundary[n * 3 + 2] * d3;
+    }
+
+    for( int k = count - 1; k >= 0; --k )
+    {
+        auto x = &data[( size_t )k * width];
+        auto n1 = k + 1 < count ? &data[( size_t )( k + 1 ) * width] : &after[( size_t )( k + 1 - count ) * width];
+        auto n2 = k + 2 < count ? &data[( size_t )( k + 2 ) * width] : &after[( size_t )( k + 2 - count ) * width];
+        auto n3 = k + 3 < count ? &data[( size_t )( k + 3 ) * width] : &after[( size_t )( k + 3 - count ) * width];
+        for( int c = 0; c < width; ++c )
+            x[c] = b * x[c] + b1 * n1[c] + b2 * n2[c] + b3 * n3[c];
+    }
+}
+
+void Filters::blur( const Blur &params, const ImageDataBase &in, ImageDataBase &out )
+{
+    makeException( params.radius >= 0 && params.sigma >= 0 );
+
+    if( static_cast<const ImageDataBase *>( &out ) == &in )
+    {
+        ImageData temporary;
+        blur( params, in, temporary );
+        temporary.copy( out );
+        return;
+    }
+
+    int w = in.w(), h = in.h();
+
+    std::unique_ptr<Recursive> recursive;
+    if( params.type == Blur::Type::gaussian && params.sigma >= 3 )
+        recursive = std::make_unique<Recursive>( params.sigma );
+
+    // Reach of the filter, lines are padded by it with the border, beyond the padding the signal is taken as constant
+    int reach = params.type == Blur::Type::box ? params.radius : ( int )RoundUp( 3 * params.sigma );
+
+    // Crop is computed as extend, only pixels with windows inside of the image are kept
+    bool crop = params.border == Border::crop;
+    auto border = crop ? Border::extend : params.border;
+    int shrink = crop ? reach : 0;
+    int ow = w - 2 * shrink, oh = h - 2 * shrink;
+    if( ow <= 0 || oh <= 0 )
+    {
+        out.reset( Max( ow, 0 ), Max( oh, 0 ) );
+        return;
+    }
+
+    auto constant = params.border == Border::cropKernel ? Pixel( 0, 0, 0, 0 ) : params.constant;
+    float fill[4] = { ( float )constant.r, ( float )constant.g, ( float )constant.b, ( float )constant.a };
+
+    // Horizontal pass, 4 floats per pixel in r, g, b, a order
+    std::vector<float> buffer( ( size_t )w * h * 4 );
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        std::vector<float> line( ( size_t )( w + 2 * reach ) * 4 ), temporary;
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = in( 0, i );
+            for( int k = 0; k < w + 2 * reach; ++k )
+            {
+                auto o = &line[( size_t )k * 4];
+                auto j = borderIndex( border, k - reach, w );
+                if( j < 0 )
+                {
+                    std::copy( fill, fill + 4, o );
+                    continue;
+                }
+                o[0] = p[j].r;
+                o[1] = p[j].g;
+                o[2] = p[j].b;
+                o[3] = p[j].a;
+            }
+
+            blurLine( params, recursive.get(), line.data(), w + 2 * reach, 4, temporary );
+            std::copy( line.begin() + reach * 4, line.begin() + ( reach + w ) * 4, buffer.begin() + ( size_t )i * w * 4 );
+        }
     } );
-    output.transform( out, ( TransformOut )[&]( int, int, int, int, const B4 & b, Pixel & p )
-    {
-        Color c;
-        c.r = x.normalize( b.x );
-        c.g = y.normalize( b.y );
-        c.b = z.normalize( b.z );
-        c.a = params.alpha ? w.normalize( b.w ) : 1;
-        p = ( Pixel )c;
+
+    out.reset( ow, oh );
+
+    // Vertical pass over stripes of columns, whole rows of a stripe are filtered at once
+    int stripe = 64;
+    Parallel::rows( ( w + stripe - 1 ) / stripe, [&]( int begin, int end )
+    {
+        std::vector<float> block, temporary;
+        for( int s = begin; s < end; ++s )
+        {
+            int j0 = s * stripe;
+            int width = Min( stripe, w - j0 );
+
+            block.resize( ( size_t )( h + 2 * reach ) * width * 4 );
+            for( int k = 0; k < h + 2 * reach; ++k )
+            {
+                auto o = &block[( size_t )k * width * 4];
+                auto i = borderIndex( border, k - reach, h );
+                if( i < 0 )
+                {
+                    for( int j = 0; j < width; ++j )
+                        std::copy( fill, fill + 4, o + j * 4 );
+                    continue;
+                }
+                auto source = &buffer[( ( size_t )i * w + j0 ) * 4];
+                std::copy( source, source + width * 4, o );
+            }
+
+            blurLine( params, recursive.get(), block.data(), h + 2 * reach, width * 4, temporary );
+
+            auto channel = []( float v )
+            {
+                return ( unsigned char )Min( Max( v + 0.5f, 0.0f ), 255.0f );
+            };
+
+            for( int i = 0; i < oh; ++i )
+            {
+                auto row = &block[( size_t )( i + shrink + reach ) * width * 4];
+                auto o = out( 0, i );
+                for( int j = Max( j0, shrink ); j < Min( j0 + width, shrink + ow ); ++j )
+                {
+                    auto c = row + ( j - j0 ) * 4;
+                    o[j - shrink] = Pixel( channel( c[0] ), channel( c[1] ), channel( c[2] ), params.alpha ? channel( c[3] ) : 255 );
+                }
+            }
+        }
     } );
 }
 
-RandomNumber Filters::randomNumber( 926374 );
+RandomStream Filters::randomStream( 926374 );
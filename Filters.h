@@ -1,8 +1,9 @@
 #pragma once
 
-#include "RandomNumber.h"
+#include "RandomStream.h"
 
 #include "ImageDataBase.h"
+#include "DeepImage.h"
 
 class B4
 {
@@ -76,7 +77,8 @@ public:
         constant,
     };
 
-    static RandomNumber randomNumber;
+    // noize draws from a stream split by pixel position, so its result doesn't depend on traversal order
+    static RandomStream randomStream;
 
     static void fiveSectors( double x, double y, Color w, Color &z );
     static void function0( double x, double y, Color w, Color &z );
@@ -178,6 +180,14 @@ public:
         }
     }
 
+    // How convolution results are mapped back to [0, 1]
+    enum class Range
+    {
+        normalize, // by minimum and maximum of the whole result, which is kept or computed twice
+        kernel,    // by sums of negative and positive weights of the kernel
+        clamp
+    };
+
     class Convolution
     {
     public:
@@ -185,6 +195,9 @@ public:
         Border border;
         B4 constant;
         bool alpha;
+        Range range;
+        // Bytes of results kept by Range::normalize, 32 per pixel, larger results are computed twice instead
+        size_t memory;
 
         Convolution();
 
@@ -199,5 +212,62 @@ public:
         void checkerboard();
     };
 
+    // Streams bands of rows concurrently, memory is proportional to width and kernel height
     static void convolution( const Convolution &params, const ImageDataBase &in, ImageDataBase &out );
+    // Input of w x h pixels is produced row by row by source( y, row ), which is called concurrently,
+    // bands of rows ask for kernel.h() - 1 rows of their neighbours too
+    using Rows = std::function<void( int, Pixel * )>;
+    static void convolution( const Convolution &params, int w, int h, const Rows &source, ImageDataBase &out );
+    // Float results are mapped by the same range, but not quantized
+    static void convolution( const Convolution &params, const ImageF &in, ImageF &out );
+
+    // Stretches every channel to the full range, alpha is left as is unless asked
+    static void normalize( const ImageDataBase &in, ImageDataBase &out, bool alpha = false );
+
+    // Picks a value of a given rank from the square window around every pixel, channel by channel
+    class Rank
+    {
+    public:
+        int radius;
+        double rank; // 0 is minimum, 0.5 is median, 1 is maximum
+        Border border;
+        Pixel constant;
+        bool alpha;
+
+        Rank();
+
+        void median( int r );
+        void erode( int r );
+        void dilate( int r );
+        void percentile( int r, double p );
+    };
+
+    // Cost per pixel doesn't depend on radius, row bands are processed concurrently
+    static void rank( const Rank &params, const ImageDataBase &in, ImageDataBase &out );
+
+    // Separable blurs with a cost per pixel, that doesn't depend on radius
+    class Blur
+    {
+    public:
+        enum class Type
+        {
+            box,
+            gaussian
+        };
+
+        Type type;
+        int radius;
+        double sigma;
+        Border border;
+        Pixel constant;
+        bool alpha;
+
+        Blur();
+
+        void box( int r );
+        void gaussian( double s );
+    };
+
+    // Gaussian is recursive (Young and van Vliet), box is a running sum
+    static void blur( const Blur &params, const ImageDataBase &in, ImageDataBase &out );
 };
@@ -9,9 +9,12 @@
 #include "Window.h"
 #include "Basic.h"
 
+#include "Composite.h"
 #include "GetImage.h"
 #include "Ellipse.h"
+#include "Planar.h"
 #include "Line.h"
+#include "Raw.h"
 
 // https://en.wikipedia.org/wiki/ICO_(file_format)
 
@@ -174,6 +177,9 @@ ImageData::~ImageData()
 
 bool ImageData::input( const std::filesystem::path &path )
 {
+    if( Raw::matches( path ) )
+        return Raw::read( path, *this );
+
     try
     {
         std::ifstream file( path, std::ios::binary );
@@ -211,6 +217,9 @@ bool ImageData::input( const std::filesystem::path &path )
 
 bool ImageData::output( const std::filesystem::path &path ) const
 {
+    if( Raw::matches( path ) )
+        return Raw::write( path, *this );
+
     try
     {
         auto ext = path.extension().string();
@@ -279,22 +288,25 @@ bool ImageData::readDDS( const std::filesystem::path &path, std::vector<ImageDat
     fread( &dwDds, sizeof( dwDds ), 1, f );
     fread( &header, sizeof( header ), 1, f );
 
+    // Either a volume of equal slices or a mip chain
+    bool volume = ( header.dwFlags == 0x80100f ) && ( header.dwCaps == 0x1000 ) && ( header.dwCaps2 == 0x200000 );
+    bool mipmaps = ( header.dwFlags == 0x2100f ) && ( header.dwCaps == 0x401008 ) && ( header.dwCaps2 == 0 );
+
     if( !(
                 ( dwDds == 0x20534444 ) &&
                 ( header.ddspf.dwFlags == 0x41 ) &&
                 ( header.ddspf.dwRGBBitCount == 32 ) &&
-                ( header.dwFlags == 0x80100f ) &&
-                ( header.dwCaps == 0x1000 ) &&
-                ( header.dwCaps2 == 0x200000 )
+                ( volume || mipmaps )
             ) ) return false;
 
-    auto size = header.dwDepth;
+    auto size = volume ? header.dwDepth : header.dwMipMapCount;
     images.resize( size );
 
-    w = header.dwWidth;
-    h = header.dwHeight;
     for( k = 0; k < size; ++k )
     {
+        w = volume ? header.dwWidth : Max( header.dwWidth >> k, 1u );
+        h = volume ? header.dwHeight : Max( header.dwHeight >> k, 1u );
+
         images[k].reset( w, h );
         for( i = 0; i < h; ++i )
         {
@@ -312,7 +324,7 @@ bool ImageData::readDDS( const std::filesystem::path &path, std::vector<ImageDat
     return true;
 }
 
-bool ImageData::writeDDS( const std::filesystem::path &fname, const std::vector<ImageData> &img )
+bool ImageData::writeDDS( const std::filesystem::path &fname, const std::vector<ImageData> &img, bool mipmaps )
 {
     Finalizer _;
 
@@ -332,18 +344,25 @@ bool ImageData::writeDDS( const std::filesystem::path &fname, const std::vector<
 
     for( k = 0; k < size; ++k )
     {
-        if( img[k].w() != w || img[k].h() != h )
+        if( mipmaps )
+        {
+            if( img[k].w() != Max( w >> k, 1 ) || img[k].h() != Max( h >> k, 1 ) )
+                return false;
+        }
+        else if( img[k].w() != w || img[k].h() != h )
+        {
             return false;
+        }
     }
 
     dwDds = 0x20534444;
     header.dwSize = sizeof( header );
-    header.dwFlags = 0x80100f;
+    header.dwFlags = mipmaps ? 0x2100f : 0x80100f;
     header.dwHeight = h;
     header.dwWidth = w;
     header.dwPitchOrLinearSize = ( header.dwWidth * 32 + 7 ) / 8;
-    header.dwDepth = size;
-    header.dwMipMapCount = 1;
+    header.dwDepth = mipmaps ? 0 : size;
+    header.dwMipMapCount = mipmaps ? size : 1;
     header.dwReserved1[0] = 0;
     header.dwReserved1[1] = 0;
     header.dwReserved1[2] = 0;
@@ -363,8 +382,8 @@ bool ImageData::writeDDS( const std::filesystem::path &fname, const std::vector<
     header.ddspf.dwGBitMask = 0x0000ff00;
     header.ddspf.dwBBitMask = 0x00ff0000;
     header.ddspf.dwABitMask = 0xff000000;
-    header.dwCaps = 0x1000;
-    header.dwCaps2 = 0x200000;
+    header.dwCaps = mipmaps ? 0x401008 : 0x1000;
+    header.dwCaps2 = mipmaps ? 0 : 0x200000;
     header.dwCaps3 = 0;
     header.dwCaps4 = 0;
     header.dwReserved2 = 0;
@@ -385,6 +404,8 @@ bool ImageData::writeDDS( const std::filesystem::path &fname, const std::vector<
 
     for( k = 0; k < size; ++k )
     {
+        w = img[k].w();
+        h = img[k].h();
         for( i = 0; i < h; ++i )
         {
             for( j = 0; j < w; ++j )
@@ -771,9 +792,6 @@ void ImageData::invert( ImageDataBase &imageDataBase ) const
 
 void ImageData::shiftRGB( ImageDataBase &imageDataBase, int rx, int ry, int gx, int gy, int bx, int by ) const
 {
-    Pixel pi, *rpo, *gpo, *bpo;
-    int i, j, mx, my;
-
     auto o = dynamic_cast<ImageData *>( &imageDataBase );
     if( !o )
         return;
@@ -784,36 +802,23 @@ void ImageData::shiftRGB( ImageDataBase &imageDataBase, int rx, int ry, int gx,
         return;
     }
 
-    auto &output = *o;
-
-    mx = rx;
-    if( mx < gx )
-        mx = gx;
-    if( mx < bx )
-        mx = bx;
+    int mx = Max( Max( Max( rx, gx ), bx ), 0 );
+    int my = Max( Max( Max( ry, gy ), by ), 0 );
 
-    my = ry;
-    if( my < gy )
-        my = gy;
-    if( my < by )
-        my = by;
+    // Every channel is a plain copy of rows of its plane
+    Planar source, result( w() + mx, h() + my );
+    source.deinterleave( *this );
 
-    output.reset( w() + mx, h() + my, Pixel( 0, 0, 0 ) );
+    using Channel = Planar::Channel;
+    result.fill( Channel::r, 0 );
+    result.fill( Channel::g, 0 );
+    result.fill( Channel::b, 0 );
+    result.fill( Channel::a, 255 );
+    result.place( Channel::r, source, rx, ry );
+    result.place( Channel::g, source, gx, gy );
+    result.place( Channel::b, source, bx, by );
 
-    for( j = 0; j < w(); ++j )
-    {
-        for( i = 0; i < h(); ++i )
-        {
-            pi = *( *this )( j, i );
-            rpo = output( j + rx, i + ry );
-            gpo = output( j + gx, i + gy );
-            bpo = output( j + bx, i + by );
-
-            rpo->r = pi.r;
-            gpo->g = pi.g;
-            bpo->b = pi.b;
-        }
-    }
+    result.interleave( *o );
 }
 
 void ImageData::function( ImageDataBase &out, const std::function<void( double, double, const Color &, Color & )> &f ) const
@@ -845,9 +850,6 @@ void ImageData::function( ImageDataBase &out, const std::function<void( int, int
 
 void ImageData::placeTransperent( ImageDataBase &imageDataBase, int x, int y ) const
 {
-    int i, j, mini, minj, maxi, maxj;
-    Pixel pi, *po;
-
     auto o = dynamic_cast<ImageData *>( &imageDataBase );
     if( !o )
         return;
@@ -858,31 +860,5 @@ void ImageData::placeTransperent( ImageDataBase &imageDataBase, int x, int y ) c
         return;
     }
 
-    auto &output = *o;
-
-    mini = y;
-    if( mini < 0 )
-        mini = 0;
-
-    minj = x;
-    if( minj < 0 )
-        minj = 0;
-
-    maxj = x + w();
-    if( maxj > output.w() )
-        maxj = output.w();
-
-    maxi = y + h();
-    if( maxi > output.h() )
-        maxi = output.h();
-
-    for( j = minj; j < maxj; ++j )
-    {
-        for( i = mini; i < maxi; ++i )
-        {
-            pi = *( *this )( j - x, i - y );
-            po = output( j, i );
-            *po = ( Pixel )( ( ( Color ) * po ).layer( ( Color )pi ) );
-        }
-    }
+    Composite::compose( *this, *o, x, y, Composite::Operator::over );
 }
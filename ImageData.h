@@ -33,7 +33,8 @@ public:
     bool output() const override;
 
     static bool readDDS( const std::filesystem::path &path, std::vector<ImageData> &images );
-    static bool writeDDS( const std::filesystem::path &path, const std::vector<ImageData> &images );
+    // With mipmaps images are a chain of halving levels, otherwise equally sized slices of a volume
+    static bool writeDDS( const std::filesystem::path &path, const std::vector<ImageData> &images, bool mipmaps = false );
 
     static bool readICO( const std::filesystem::path &path, std::vector<ImageData> &images );
     static bool writeICO( const std::filesystem::path &path, const std::vector<ImageData> &images );
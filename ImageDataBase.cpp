@@ -3,15 +3,6 @@
 #include "Exception.h"
 #include "Basic.h"
 
-Pixel::Pixel()
-{
-    r = g = b = 0;
-    a = 255;
-}
-
-Pixel::Pixel( unsigned char red, unsigned char green, unsigned char blue, unsigned char alpha ) : b( blue ), g( green ), r( red ), a( alpha )
-{}
-
 bool Pixel::operator==( Pixel other ) const
 {
     return ( r == other.r ) && ( g == other.g ) && ( b == other.b ) && ( a == other.a );
@@ -34,15 +25,6 @@ Pixel::operator const Color() const
 
 double Color::epsilon = 1e-6;
 
-Color::Color()
-{
-    r = g = b = 0;
-    a = 1;
-}
-
-Color::Color( double red, double green, double blue, double alpha ) : r( red ), g( green ), b( blue ), a( alpha )
-{}
-
 bool Color::operator==( Color other ) const
 {
     return ( Abs( r - other.r ) <= epsilon ) &&
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <type_traits>
 #include <filesystem>
 #include <functional>
 #include <optional>
@@ -7,6 +8,8 @@
 
 #include "Matrix.h"
 
+#include "Parallel.h"
+
 class Color;
 
 class Pixel
@@ -14,8 +17,11 @@ class Pixel
 public:
     unsigned char b, g, r, a;
 
-    Pixel();
-    Pixel( unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255 );
+    Pixel() : b( 0 ), g( 0 ), r( 0 ), a( 255 )
+    {}
+
+    Pixel( unsigned char red, unsigned char green, unsigned char blue, unsigned char alpha = 255 ) : b( blue ), g( green ), r( red ), a( alpha )
+    {}
 
     bool operator==( Pixel other ) const;
     bool operator!=( Pixel other ) const;
@@ -32,8 +38,11 @@ public:
 
     double r, g, b, a;
 
-    Color();
-    Color( double r, double g, double b, double a = 1 );
+    Color() : r( 0 ), g( 0 ), b( 0 ), a( 1 )
+    {}
+
+    Color( double red, double green, double blue, double alpha = 1 ) : r( red ), g( green ), b( blue ), a( alpha )
+    {}
 
     bool operator==( Color other ) const;
     bool operator!=( Color other ) const;
@@ -90,5 +99,129 @@ public:
 
     virtual void placeTransperent( ImageDataBase &out, int x, int y ) const = 0;
 
+    // f is any callable of ( const Pixel &, Pixel & ), ( int w, int h, int j, int i, const Pixel &, Pixel & ),
+    // ( const Color &, Color & ) or ( double x, double y, const Color &, Color & ), wrapped in pure() rows are processed concurrently
+    template<typename F>
+    void map( ImageDataBase &out, const F &f ) const;
+
+    template<typename F>
+    void map( const F &f );
+
     virtual ~ImageDataBase() {}
 };
+
+namespace PixelConvert
+{
+template<typename>
+inline constexpr bool alwaysFalse = false;
+
+template<typename F>
+struct IsPure : std::false_type
+{};
+
+template<typename F>
+struct IsPure<Pure<F>> : std::true_type
+{};
+
+template<typename F>
+inline const F &unwrap( const F &f )
+{
+    return f;
+}
+
+template<typename F>
+inline const F &unwrap( const Pure<F> &p )
+{
+    return p.f;
+}
+
+inline Color toColor( const Pixel &p )
+{
+    constexpr double k = 1.0 / 255;
+    return Color( p.r * k, p.g * k, p.b * k, p.a * k );
+}
+
+inline unsigned char toChannel( double v )
+{
+    if( !( v > 0 ) )
+        return 0;
+    if( v >= 1 )
+        return 255;
+    return ( unsigned char )( v * 255 + 0.5 );
+}
+
+// Unlike the explicit Color to Pixel conversion, values out of range are clamped instead of failing
+inline Pixel toPixel( const Color &c )
+{
+    return Pixel( toChannel( c.r ), toChannel( c.g ), toChannel( c.b ), toChannel( c.a ) );
+}
+}
+
+template<typename F>
+void ImageDataBase::map( ImageDataBase &out, const F &function ) const
+{
+    using namespace PixelConvert;
+
+    const auto &f = unwrap( function );
+    using G = decltype( f );
+
+    int width = w();
+    int height = h();
+
+    if( out.w() != width || out.h() != height )
+        out.reset( width, height );
+
+    auto band = [&]( int i0, int i1 )
+    {
+        for( int i = i0; i < i1; ++i )
+        {
+            const Pixel *in = ( *this )( 0, i );
+            Pixel *o = out( 0, i );
+
+            for( int j = 0; j < width; ++j )
+            {
+                if constexpr( std::is_invocable_v<G, const Pixel &, Pixel &> )
+                {
+                    Pixel z = in[j];
+                    f( in[j], z );
+                    o[j] = z;
+                }
+                else if constexpr( std::is_invocable_v<G, int, int, int, int, const Pixel &, Pixel &> )
+                {
+                    Pixel z = in[j];
+                    f( width, height, j, i, in[j], z );
+                    o[j] = z;
+                }
+                else if constexpr( std::is_invocable_v<G, const Color &, Color &> )
+                {
+                    auto c = toColor( in[j] );
+                    Color z = c;
+                    f( c, z );
+                    o[j] = toPixel( z );
+                }
+                else if constexpr( std::is_invocable_v<G, double, double, const Color &, Color &> )
+                {
+                    auto c = toColor( in[j] );
+                    Color z = c;
+                    f( ( j + 0.5 ) / width - 0.5, ( i + 0.5 ) / height - 0.5, c, z );
+                    o[j] = toPixel( z );
+                }
+                else
+                {
+                    static_assert( alwaysFalse<F>, "Unsupported pixel function signature" );
+                }
+            }
+        }
+    };
+
+    if constexpr( IsPure<F>::value )
+        Parallel::rows( height, band );
+    else
+        band( 0, height );
+}
+
+template<typename F>
+void ImageDataBase::map( const F &f )
+{
+    map( *this, f );
+}
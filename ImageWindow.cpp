@@ -236,12 +236,22 @@ void ImageWindow::run()
 
             auto edit = [&]( JustEdit::Entity * target )
             {
+                // Values are set through the journal, all changes of one dialog are undone together
                 Settings::Parameters parameters;
                 for( auto& [name, set, get, options] : target->editData() )
-                    parameters.emplace_back( name, set, get, options );
+                {
+                    auto field = name;
+                    auto journaled = [this, target, field]( const std::wstring & value )
+                    {
+                        return journal.field( target, field, value );
+                    };
+                    parameters.emplace_back( name, journaled, get, options );
+                }
 
+                journal.begin();
                 Settings settings( target->description(), parameters );
                 settings.run();
+                journal.end();
 
                 update();
             };
@@ -254,31 +264,31 @@ void ImageWindow::run()
 
                 if( itemId == 0 )
                 {
-                    selection->select( root->add( std::make_shared<JustEdit::Raster>( getFreeName( L"raster" ), 64, 64, Position( p ) ) ), false );
+                    selection->select( journal.add( root, std::make_shared<JustEdit::Raster>( getFreeName( L"raster" ), 64, 64, Position( p ) ) ), false );
                 }
                 else if( itemId == 1 )
                 {
-                    selection->select( root->add( std::make_shared<JustEdit::Line>( getFreeName( L"line" ), p, p + Vector2D( 32, 32 ) ) ), false );
+                    selection->select( journal.add( root, std::make_shared<JustEdit::Line>( getFreeName( L"line" ), p, p + Vector2D( 32, 32 ) ) ), false );
                 }
                 else if( itemId == 2 )
                 {
-                    selection->select( root->add( std::make_shared<JustEdit::Rectangle>( getFreeName( L"rectangle" ), 32, 16, Position( p ) ) ), false );
+                    selection->select( journal.add( root, std::make_shared<JustEdit::Rectangle>( getFreeName( L"rectangle" ), 32, 16, Position( p ) ) ), false );
                 }
                 else if( itemId == 3 )
                 {
-                    selection->select( root->add( std::make_shared<JustEdit::Circle>( getFreeName( L"circle" ), p, 24 ) ), false );
+                    selection->select( journal.add( root, std::make_shared<JustEdit::Circle>( getFreeName( L"circle" ), p, 24 ) ), false );
                 }
                 else if( itemId == 4 )
                 {
-                    selection->select( root->add( std::make_shared<JustEdit::Text>( getFreeName( L"text" ), L"Lorem ipsum", Position( p ) ) ), false );
+                    selection->select( journal.add( root, std::make_shared<JustEdit::Text>( getFreeName( L"text" ), L"Lorem ipsum", Position( p ) ) ), false );
                 }
                 else if( itemId == 5 )
                 {
-                    selection->select( root->add( std::make_shared<JustEdit::Polygon>( getFreeName( L"polygon" ), Position( p ) ) ), false );
+                    selection->select( journal.add( root, std::make_shared<JustEdit::Polygon>( getFreeName( L"polygon" ), Position( p ) ) ), false );
                 }
                 else if( itemId == 6 )
                 {
-                    selection->select( root->add( std::make_shared<JustEdit::Point>( getFreeName( L"point" ), 0, p ) ), false );
+                    selection->select( journal.add( root, std::make_shared<JustEdit::Point>( getFreeName( L"point" ), 0, p ) ), false );
                 }
 
                 update();
@@ -286,11 +296,24 @@ void ImageWindow::run()
 
             static uint16_t toolId = 0;
             static std::optional<Vector2D> initialCanvasGrab;
+            // Target dragged by the selection with its position before, and the raster and the last point of a pixel stroke
+            static JustEdit::Entity *grabbed = nullptr;
+            static JustEdit::Position grabbedPosition;
+            static JustEdit::Raster *stroke = nullptr;
+            static Vector2D strokePoint;
             auto pickTool = [&]( uint16_t id )
             {
                 toolId = id;
             };
 
+            // Ends the stroke and the drag, before the journal or the document change under them
+            auto finish = [&]()
+            {
+                journal.commit();
+                stroke = nullptr;
+                grabbed = nullptr;
+            };
+
             auto modify = [&]( JustEdit::Entity * target, int modificationId, bool test )
             {
                 if( !target || target == root || target->type() != L"Raster" )
@@ -302,8 +325,13 @@ void ImageWindow::run()
                 if( modificationId == 0 )
                 {
                     auto targetRoot = target->getRoot();
-                    selection->select( targetRoot->add( std::make_shared<JustEdit::Perspective>( getFreeName( L"perspective" ), target, target->position ) ), false );
+                    auto before = target->position;
+
+                    journal.begin();
+                    selection->select( journal.add( targetRoot, std::make_shared<JustEdit::Perspective>( getFreeName( L"perspective" ), target, target->position ) ), false );
                     target->position = JustEdit::Position();
+                    journal.moved( target, before );
+                    journal.end();
                     update();
                 }
 
@@ -334,8 +362,10 @@ void ImageWindow::run()
 
                 selection->select( nullptr, false );
 
+                journal.begin();
                 for( auto target : targets )
-                    target->detach();
+                    journal.detach( target );
+                journal.end();
 
                 update();
                 return true;
@@ -356,13 +386,16 @@ void ImageWindow::run()
 
                     auto nodes = targets[0]->getRoot()->getNodes();
                     auto g = std::make_shared<JustEdit::Group>( L"group" );
+
+                    journal.begin();
                     for( auto target : nodes )
                     {
                         if( std::find( targets.begin(), targets.end(), target ) != targets.end() )
-                            g->add( target->detach() );
+                            journal.add( g.get(), journal.detach( target ) );
                     }
 
-                    root->add( g );
+                    journal.add( root, g );
+                    journal.end();
                     update();
                     return true;
                 }
@@ -380,22 +413,28 @@ void ImageWindow::run()
 
                 selection->select( nullptr, false );
 
+                journal.begin();
                 for( auto node : nodes )
                 {
+                    auto before = node->position;
                     node->position( g->position() * node->position() );
-                    root->add( node->detach() );
+                    journal.moved( node, before );
+                    journal.add( root, journal.detach( node ) );
                 }
 
-                g->detach();
+                journal.detach( g );
+                journal.end();
                 update();
                 return true;
             };
 
             auto open = [&]()
             {
+                finish();
                 auto newRoot = JustEdit::Entity::load();
                 if( newRoot )
                 {
+                    journal.clear();
                     rootObject = newRoot;
                     updateRoot();
                     update();
@@ -423,13 +462,14 @@ void ImageWindow::run()
                 auto raster = std::make_shared<JustEdit::Raster>( getFreeName( L"import" ), 64, 64, JustEdit::Position( camera.inv()( p ) ) );
 
                 raster->image->input();
+                raster->invalidate();
                 raster->w = raster->image->w();
                 raster->h = raster->image->h();
 
                 raster->position.scaleX = 64.0 / raster->w;
                 raster->position.scaleY = 64.0 / raster->h;
 
-                root->add( raster );
+                journal.add( root, raster );
                 selection->select( raster.get(), false );
                 update();
             };
@@ -454,11 +494,25 @@ void ImageWindow::run()
 
             auto undo = [&]( bool f )
             {
-                Popup( Popup::Type::Info, L"Change buffer", f ? L"Undone is not implemented" : L"Redone is not implemented" ).run();
+                finish();
+                selection->select( nullptr, false );
+                if( !( f ? journal.undo() : journal.redo() ) )
+                    return;
+
+                // The viewed entity may have been detached by the change
+                auto top = root;
+                while( top->getRoot() )
+                    top = top->getRoot();
+                if( top != rootObject.get() )
+                    root = rootObject.get();
+
+                update();
             };
 
             auto view = [&]( JustEdit::Entity * target, bool test )
             {
+                if( !test )
+                    finish();
                 if( target )
                 {
                     Vector2D a, b;
@@ -535,6 +589,12 @@ void ImageWindow::run()
             if( *input.ctrl && keyDown( 'S' ) )
                 save();
 
+            if( *input.ctrl && keyDown( 'Z' ) )
+                undo( true );
+
+            if( *input.ctrl && keyDown( 'Y' ) )
+                undo( false );
+
             if( *input.ctrl && *input.up && input.up.changed() )
             {
                 if( auto target = selection->getTarget() )
@@ -578,6 +638,9 @@ void ImageWindow::run()
                         if( selection->grab( camera, point ) )
                         {
                             isSelection = true;
+                            grabbed = selection->getTarget();
+                            if( grabbed )
+                                grabbedPosition = grabbed->position;
                         }
                         else
                         {
@@ -590,6 +653,15 @@ void ImageWindow::run()
                     }
                     else if( toolId == 1 && dynamic_cast<JustEdit::Raster*>( root ) )
                     {
+                        auto raster = dynamic_cast<JustEdit::Raster*>( root );
+                        auto& pixels = journal.paint( raster );
+                        stroke = raster;
+                        strokePoint = camera.inv()( point );
+
+                        int x = Round( strokePoint.x ), y = Round( strokePoint.y );
+                        pixels.line( x, y, x, y, ( Pixel )raster->contour );
+                        raster->invalidate();
+                        update();
                     }
                     else if( toolId == 2 )
                     {
@@ -704,6 +776,14 @@ void ImageWindow::run()
                     if( selection->move( camera, Vector2D( *input.mouseX, *input.mouseY ) ) )
                         update();
                 }
+                else if( toolId == 1 && stroke )
+                {
+                    auto p = camera.inv()( Vector2D( *input.mouseX, *input.mouseY ) );
+                    stroke->pixels().line( Round( strokePoint.x ), Round( strokePoint.y ), Round( p.x ), Round( p.y ), ( Pixel )stroke->contour );
+                    strokePoint = p;
+                    stroke->invalidate();
+                    update();
+                }
                 else if( toolId == 2 && initialCanvasGrab )
                 {
                     camera.s = *initialCanvasGrab + Vector2D( *input.mouseX, *input.mouseY );
@@ -714,6 +794,14 @@ void ImageWindow::run()
             if( input.leftMouse.changed() && !*input.leftMouse )
             {
                 selection->release();
+                if( grabbed )
+                    journal.moved( grabbed, grabbedPosition );
+                grabbed = nullptr;
+
+                if( stroke )
+                    journal.commit();
+                stroke = nullptr;
+
                 if( toolId == 3 && initialCanvasGrab )
                 {
                     auto inv = camera.inv();
@@ -10,6 +10,7 @@
 
 #include "ImageDataBase.h"
 #include "JustEdit.h"
+#include "Journal.h"
 
 class ImageWindow
 {
@@ -50,6 +51,7 @@ private:
     std::shared_ptr<JustEdit::Selection> selection;
     std::shared_ptr<JustEdit::Entity> rootObject;
     JustEdit::Entity *root;
+    JustEdit::Journal journal;
     Affine2D camera;
 
     Data data;
@@ -0,0 +1,388 @@
+#include "Journal.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ImageData.h"
+#include "Basic.h"
+
+namespace JustEdit
+{
+const int Journal::tile = 64;
+
+Journal::Command::~Command()
+{}
+
+// Moves shorter than epsilon are not recorded
+static const double epsilon = 1e-9;
+
+static bool same( double a, double b )
+{
+    return Abs( a - b ) <= epsilon;
+}
+
+static bool same( const Position& a, const Position& b )
+{
+    return same( a.shear, b.shear ) && same( a.scaleX, b.scaleX ) && same( a.scaleY, b.scaleY ) && same( a.rotation, b.rotation ) && same( a.shift.x, b.shift.x ) && same( a.shift.y, b.shift.y );
+}
+
+static bool assign( Entity *target, const std::wstring& name, const std::wstring& value )
+{
+    for( auto& field : target->editData() )
+    {
+        if( std::get<0>( field ) == name )
+            return std::get<1>( field )( value );
+    }
+    return false;
+}
+
+// Pixels of a raster, which the raster does not share with anything
+static ImageDataBase &writable( Raster *raster )
+{
+    raster->pixels();
+    if( raster->image.use_count() > 1 )
+    {
+        auto copy = std::make_shared<ImageData>();
+        raster->image->copy( *copy );
+        raster->replace( copy );
+    }
+    return *raster->image;
+}
+
+class Batch : public Journal::Command
+{
+private:
+    std::vector<std::unique_ptr<Journal::Command>> commands;
+public:
+    explicit Batch( std::vector<std::unique_ptr<Journal::Command>> c ) : commands( std::move( c ) )
+    {}
+
+    virtual void undo() override
+    {
+        for( auto i = commands.rbegin(); i != commands.rend(); ++i )
+            ( *i )->undo();
+    }
+
+    virtual void redo() override
+    {
+        for( auto& command : commands )
+            command->redo();
+    }
+};
+
+// Rasters with changed sizes keep their pixels from before the change
+class Field : public Journal::Command
+{
+private:
+    Entity *target;
+    std::wstring name, before, after;
+    std::shared_ptr<ImageDataBase> pixels;
+public:
+    Field( Entity *t, std::wstring n, std::wstring b, std::wstring a, std::shared_ptr<ImageDataBase> p ) :
+        target( t ), name( std::move( n ) ), before( std::move( b ) ), after( std::move( a ) ), pixels( std::move( p ) )
+    {}
+
+    virtual void undo() override
+    {
+        assign( target, name, before );
+        auto raster = dynamic_cast<Raster*>( target );
+        if( raster && pixels && raster->image != pixels )
+            raster->replace( pixels );
+    }
+
+    virtual void redo() override
+    {
+        assign( target, name, after );
+    }
+};
+
+class Move : public Journal::Command
+{
+private:
+    Entity *target;
+    Position before, after;
+public:
+    Move( Entity *t, const Position& b ) : target( t ), before( b ), after( t->position )
+    {}
+
+    virtual void undo() override
+    {
+        target->position = before;
+    }
+
+    virtual void redo() override
+    {
+        target->position = after;
+    }
+};
+
+// Node attached to parent or detached from it, the node is held in both states
+class Link : public Journal::Command
+{
+private:
+    Entity *parent;
+    std::shared_ptr<Entity> node;
+    size_t index;
+    bool added;
+
+    void attach()
+    {
+        parent->insert( node, index );
+    }
+
+    void detach()
+    {
+        parent->remove( node.get() );
+    }
+public:
+    Link( Entity *p, std::shared_ptr<Entity> n, size_t i, bool a ) : parent( p ), node( std::move( n ) ), index( i ), added( a )
+    {}
+
+    virtual void undo() override
+    {
+        added ? detach() : attach();
+    }
+
+    virtual void redo() override
+    {
+        added ? attach() : detach();
+    }
+};
+
+class Pixels : public Journal::Command
+{
+public:
+    struct Tile
+    {
+        int x, y;
+        ImageData before, after;
+    };
+private:
+    Raster *target;
+    std::vector<Tile> tiles;
+
+    void apply( bool after )
+    {
+        auto& image = writable( target );
+        for( auto& t : tiles )
+        {
+            auto& source = after ? t.after : t.before;
+            if( t.x + source.w() > image.w() || t.y + source.h() > image.h() )
+                continue;
+            for( int i = 0; i < source.h(); ++i )
+                std::memcpy( image( t.x, t.y + i ), source( 0, i ), source.w() * sizeof( Pixel ) );
+        }
+        target->invalidate();
+    }
+public:
+    Pixels( Raster *r, std::vector<Tile> t ) : target( r ), tiles( std::move( t ) )
+    {}
+
+    virtual void undo() override
+    {
+        apply( false );
+    }
+
+    virtual void redo() override
+    {
+        apply( true );
+    }
+};
+
+Journal::Journal( size_t d ) : depth( d ), level( 0 ), painted( nullptr )
+{}
+
+void Journal::record( std::unique_ptr<Command> command )
+{
+    if( level )
+    {
+        batch.push_back( std::move( command ) );
+        return;
+    }
+
+    // Subtrees detached by undone commands are released here
+    undone.clear();
+    done.push_back( std::move( command ) );
+    if( done.size() > depth )
+        done.erase( done.begin() );
+}
+
+void Journal::begin()
+{
+    commit();
+    ++level;
+}
+
+void Journal::end()
+{
+    commit();
+    if( !level || --level )
+        return;
+
+    if( batch.size() == 1 )
+        record( std::move( batch.front() ) );
+    else if( !batch.empty() )
+        record( std::make_unique<Batch>( std::move( batch ) ) );
+    batch.clear();
+}
+
+bool Journal::field( Entity *target, const std::wstring& name, const std::wstring& value )
+{
+    commit();
+
+    for( auto& [n, setter, getter] : target->editData() )
+    {
+        if( n != name )
+            continue;
+
+        auto raster = dynamic_cast<Raster*>( target );
+        int64_t w = raster ? raster->w : 0, h = raster ? raster->h : 0;
+
+        auto before = getter();
+        if( !setter( value ) )
+            return false;
+
+        // Changed sizes of rasters are applied by drawing, which crops pixels into a new buffer
+        std::shared_ptr<ImageDataBase> pixels;
+        if( raster && ( raster->w != w || raster->h != h ) )
+        {
+            raster->pixels();
+            pixels = raster->image;
+        }
+
+        auto after = getter();
+        if( after != before )
+            record( std::make_unique<Field>( target, name, std::move( before ), std::move( after ), std::move( pixels ) ) );
+        return true;
+    }
+    return false;
+}
+
+void Journal::moved( Entity *target, const Position& before )
+{
+    commit();
+    if( target && !same( target->position, before ) )
+        record( std::make_unique<Move>( target, before ) );
+}
+
+Entity *Journal::add( Entity *parent, std::shared_ptr<Entity> node )
+{
+    commit();
+
+    auto index = parent->getNodes().size();
+    auto result = parent->add( node );
+    if( result )
+        record( std::make_unique<Link>( parent, std::move( node ), index, true ) );
+    return result;
+}
+
+std::shared_ptr<Entity> Journal::detach( Entity *node )
+{
+    commit();
+
+    auto parent = node->getRoot();
+    if( !parent )
+        return nullptr;
+
+    auto nodes = parent->getNodes();
+    auto index = ( size_t )( std::find( nodes.begin(), nodes.end(), node ) - nodes.begin() );
+    auto result = node->detach();
+    if( result )
+        record( std::make_unique<Link>( parent, result, index, false ) );
+    return result;
+}
+
+ImageDataBase &Journal::paint( Raster *raster )
+{
+    commit();
+
+    // The raster draws into a copy, the original is compared with it by commit
+    raster->pixels();
+    original = raster->image;
+    auto copy = std::make_shared<ImageData>();
+    original->copy( *copy );
+    raster->replace( copy );
+    painted = raster;
+    return *copy;
+}
+
+void Journal::commit()
+{
+    if( !painted )
+        return;
+
+    auto raster = painted;
+    auto before = std::move( original );
+    painted = nullptr;
+
+    auto& after = *raster->image;
+    raster->invalidate();
+    if( after.w() != before->w() || after.h() != before->h() )
+        return;
+
+    std::vector<Pixels::Tile> tiles;
+    for( int y = 0; y < after.h(); y += tile )
+    {
+        for( int x = 0; x < after.w(); x += tile )
+        {
+            int w = Min( tile, after.w() - x ), h = Min( tile, after.h() - y );
+
+            bool changed = false;
+            for( int i = 0; i < h && !changed; ++i )
+                changed = std::memcmp( ( *before )( x, y + i ), after( x, y + i ), w * sizeof( Pixel ) ) != 0;
+            if( !changed )
+                continue;
+
+            auto& t = tiles.emplace_back();
+            t.x = x;
+            t.y = y;
+            t.before.reset( w, h );
+            t.after.reset( w, h );
+            for( int i = 0; i < h; ++i )
+            {
+                std::memcpy( t.before( 0, i ), ( *before )( x, y + i ), w * sizeof( Pixel ) );
+                std::memcpy( t.after( 0, i ), after( x, y + i ), w * sizeof( Pixel ) );
+            }
+        }
+    }
+
+    if( !tiles.empty() )
+        record( std::make_unique<Pixels>( raster, std::move( tiles ) ) );
+}
+
+bool Journal::undo()
+{
+    commit();
+    if( done.empty() )
+        return false;
+
+    auto command = std::move( done.back() );
+    done.pop_back();
+    command->undo();
+    undone.push_back( std::move( command ) );
+    return true;
+}
+
+bool Journal::redo()
+{
+    commit();
+    if( undone.empty() )
+        return false;
+
+    auto command = std::move( undone.back() );
+    undone.pop_back();
+    command->redo();
+    done.push_back( std::move( command ) );
+    return true;
+}
+
+void Journal::clear()
+{
+    painted = nullptr;
+    original.reset();
+    done.clear();
+    undone.clear();
+    batch.clear();
+    level = 0;
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "JustEdit.h"
+
+namespace JustEdit
+{
+// Undo history of document edits as a journal of commands, which keep only what an edit changed:
+// field values, positions, detached subtrees and changed tiles of raster pixels
+// Everything else is shared with the document, so history grows with the edits and not with the document
+// Commands keep plain pointers to their targets, so edited entities have to outlive the journal:
+// clear it before its document is closed or replaced, subtrees detached through it are held by it
+class Journal
+{
+public:
+    class Command
+    {
+    public:
+        virtual ~Command();
+
+        virtual void undo() = 0;
+        virtual void redo() = 0;
+    };
+
+    // Size of tiles, in which pixel edits are stored
+    static const int tile;
+
+    explicit Journal( size_t depth = 1024 );
+
+    // Changes between begin and end are undone and redone as one
+    void begin();
+    void end();
+
+    // Sets the field through editData of target
+    bool field( Entity *target, const std::wstring& name, const std::wstring& value );
+    // Records position of target changed from before
+    void moved( Entity *target, const Position& before );
+
+    Entity *add( Entity *parent, std::shared_ptr<Entity> node );
+    std::shared_ptr<Entity> detach( Entity *node );
+
+    // Private copy of pixels of raster to draw into, commit records the changed tiles
+    ImageDataBase &paint( Raster *raster );
+    void commit();
+
+    bool undo();
+    bool redo();
+    // Forgets every command, call it before entities edited through the journal are released
+    void clear();
+private:
+    std::vector<std::unique_ptr<Command>> done, undone, batch;
+    size_t depth;
+    int level;
+
+    Raster *painted;
+    std::shared_ptr<ImageDataBase> original;
+
+    void record( std::unique_ptr<Command> command );
+};
+}
@@ -2,13 +2,19 @@
 
 #include <type_traits>
 #include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <fstream>
+#include <map>
 #include <set>
 
 #include "GetPathToFile.h"
 #include "Information.h"
 #include "Exception.h"
 #include "ImageData.h"
+#include "Resample.h"
 #include "Text.h"
+#include "Raw.h"
 
 namespace JustEdit
 {
@@ -350,6 +356,16 @@ Entity *Entity::add( std::shared_ptr<Entity> node )
     return nullptr;
 }
 
+Entity *Entity::insert( std::shared_ptr<Entity> node, size_t index )
+{
+    if( isComplex() && node )
+    {
+        node->root = this;
+        return nodes.insert( nodes.begin() + Min( index, nodes.size() ), std::move( node ) )->get();
+    }
+    return nullptr;
+}
+
 std::shared_ptr<Entity> Entity::remove( const Entity* node )
 {
     std::vector<std::shared_ptr<Entity>> newNodes;
@@ -429,95 +445,393 @@ Entity *Entity::operator()( const std::function<bool( Entity* )>& f )
     return foreachRoot( this, f );
 }
 
-static void append( Information::Wrapper& storage, const Entity & object, const std::filesystem::path& path )
+// Binary documents: header, entities in preorder, their fields, string pool, then raster
+// containers at page boundaries, so rasters can be read straight from a mapping of the file
+static const char documentMagic[4] = { 'J', 'E', 'D', 'B' };
+static const uint32_t documentVersion = 1;
+
+// Indices of these are stored in records, append new types at the end
+static const std::wstring entityTypes[] = { L"Group", L"Raster", L"Line", L"Rectangle", L"Circle", L"Text", L"Point" };
+
+enum class FieldTag : uint32_t
 {
-    using namespace Information;
+    string,
+    integer,
+    real,
+    boolean,
+    word
+};
 
-    if( object.type() == L"Selection" )
-        return;
+struct DocumentHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t records, fields;
+    uint64_t pool; // code units
+};
 
-    SerializationDescription s;
-    object.data( s );
-    s.info( L"class" ) = object.type();
+struct DocumentRecord
+{
+    uint32_t type;
+    int32_t parent; // -1 for the root
+    uint32_t first, count; // of fields
+    uint64_t offset, size; // of the raster container, zero size for other entities
+};
 
-    storage = std::move( s.info );
+// Fields are found by their names, so entities may gain or lose fields, strings point to the pool
+struct DocumentField
+{
+    FieldTag tag;
+    uint32_t length;
+    uint64_t value;
+    uint64_t name, nameLength; // in the pool
+};
 
-    storage( L"node_names" ) = Array();
-    auto& array = storage( L"node_names" ).as<Array>();
+static uint64_t roundUp( uint64_t v, uint64_t alignment )
+{
+    return ( v + alignment - 1 ) / alignment * alignment;
+}
 
-    auto fname = MetaData::fixName( object.name );
+static std::shared_ptr<Entity> create( const std::wstring& type )
+{
+    if( type == L"Group" )
+        return std::make_shared<Group>();
+    if( type == L"Raster" )
+        return std::make_shared<Raster>();
+    if( type == L"Line" )
+        return std::make_shared<Line>();
+    if( type == L"Rectangle" )
+        return std::make_shared<Rectangle>();
+    if( type == L"Circle" )
+        return std::make_shared<Circle>();
+    if( type == L"Text" )
+        return std::make_shared<Text>();
+    if( type == L"Point" )
+        return std::make_shared<Point>();
+    return nullptr;
+}
 
-    if( object.type() == L"Raster" )
-    {
-        auto raster = dynamic_cast<const Raster*>( &object );
-        if( raster )
-            raster->image->output( path / ( fname + L".png" ) );
-    }
+static void collect( const Entity& object, int32_t parent, std::vector<const Entity*>& entities, std::vector<int32_t>& parents )
+{
+    if( object.type() == L"Selection" )
+        return;
 
+    auto index = ( int32_t )entities.size();
+    entities.push_back( &object );
+    parents.push_back( parent );
     for( auto node : object.getNodes() )
+        collect( *node, index, entities, parents );
+}
+
+static DocumentField encode( const std::any& value, std::vector<uint32_t>& pool, uint64_t name, uint64_t nameLength )
+{
+    DocumentField field{ FieldTag::integer, 0, 0, name, nameLength };
+    makeException( value.has_value() );
+    if( value.type() == typeid( std::wstring* ) )
+    {
+        auto& s = *std::any_cast<std::wstring*>( value );
+        field.tag = FieldTag::string;
+        field.length = ( uint32_t )s.size();
+        field.value = pool.size();
+        pool.insert( pool.end(), s.begin(), s.end() );
+    }
+    else if( value.type() == typeid( int64_t* ) )
     {
-        Item item;
-        item = String( MetaData::fixName( node->name ) );
-        array.push( item );
-        auto wrapper = storage( node->name );
-        append( wrapper, *node, path / fname );
+        field.value = ( uint64_t ) * std::any_cast<int64_t*>( value );
     }
+    else if( value.type() == typeid( double* ) )
+    {
+        field.tag = FieldTag::real;
+        std::memcpy( &field.value, std::any_cast<double*>( value ), sizeof( double ) );
+    }
+    else if( value.type() == typeid( bool* ) )
+    {
+        field.tag = FieldTag::boolean;
+        field.value = *std::any_cast<bool*>( value );
+    }
+    else if( value.type() == typeid( uint16_t* ) )
+    {
+        field.tag = FieldTag::word;
+        field.value = *std::any_cast<uint16_t*>( value );
+    }
+    else
+    {
+        makeException( false );
+    }
+    return field;
 }
 
-bool Entity::save( const std::filesystem::path& path ) const
+// Field of the record with the name, nullptr for fields the document does not have
+static const DocumentField *find( const std::vector<DocumentField>& fields, const DocumentRecord& record, const std::wstring& name, const std::vector<uint32_t>& pool )
 {
-    using namespace Information;
+    for( uint32_t k = 0; k < record.count; ++k )
+    {
+        auto& field = fields[record.first + k];
+        makeException( field.name <= pool.size() && field.nameLength <= pool.size() - field.name );
+        if( field.nameLength != name.size() )
+            continue;
 
-    Item self;
-    Wrapper wrapper( self );
-    append( wrapper, *this, path.parent_path() );
-    return self.output( path );
+        size_t i = 0;
+        while( i < name.size() && pool[field.name + i] == ( uint32_t )name[i] )
+            ++i;
+        if( i == name.size() )
+            return &field;
+    }
+    return nullptr;
 }
 
-static std::shared_ptr<Entity> extract( const Information::Item & storage, const std::filesystem::path& path )
+static void decode( const DocumentField& field, const std::any& value, const uint32_t* pool, uint64_t poolSize )
 {
-    using namespace Information;
+    makeException( value.has_value() );
+    if( value.type() == typeid( std::wstring* ) )
+    {
+        makeException( field.tag == FieldTag::string && field.value <= poolSize && field.length <= poolSize - field.value );
+        auto& s = *std::any_cast<std::wstring*>( value );
+        s.resize( field.length );
+        for( uint32_t k = 0; k < field.length; ++k )
+            s[k] = ( wchar_t )pool[field.value + k];
+    }
+    else if( value.type() == typeid( int64_t* ) )
+    {
+        makeException( field.tag == FieldTag::integer );
+        *std::any_cast<int64_t*>( value ) = ( int64_t )field.value;
+    }
+    else if( value.type() == typeid( double* ) )
+    {
+        makeException( field.tag == FieldTag::real );
+        std::memcpy( std::any_cast<double*>( value ), &field.value, sizeof( double ) );
+    }
+    else if( value.type() == typeid( bool* ) )
+    {
+        makeException( field.tag == FieldTag::boolean );
+        *std::any_cast<bool*>( value ) = field.value != 0;
+    }
+    else if( value.type() == typeid( uint16_t* ) )
+    {
+        makeException( field.tag == FieldTag::word );
+        *std::any_cast<uint16_t*>( value ) = ( uint16_t )field.value;
+    }
+    else
+    {
+        makeException( false );
+    }
+}
 
-    std::shared_ptr<Entity> object;
-    ImageDataBase *image = nullptr;
+bool Entity::save( const std::filesystem::path& path ) const
+{
+    std::vector<const Entity*> entities;
+    std::vector<int32_t> parents;
+    collect( *this, -1, entities, parents );
 
-    auto type = ( std::wstring )storage( L"class" ).as<String>();
-    if( type == L"Group" )
+    std::vector<DocumentRecord> records( entities.size() );
+    std::vector<DocumentField> fields;
+    std::vector<uint32_t> pool;
+    std::map<std::wstring, uint64_t> names;
+    try
     {
-        object = std::make_shared<Group>();
+        for( size_t k = 0; k < entities.size(); ++k )
+        {
+            auto type = std::find( std::begin( entityTypes ), std::end( entityTypes ), entities[k]->type() );
+            makeException( type != std::end( entityTypes ) );
+
+            auto& record = records[k];
+            record.type = ( uint32_t )( type - std::begin( entityTypes ) );
+            record.parent = parents[k];
+            record.first = ( uint32_t )fields.size();
+            for( auto& [field, value] : const_cast<Entity*>( entities[k] )->deserializationData() )
+            {
+                // Names are shared by fields of all entities
+                auto shared = names.emplace( field, pool.size() );
+                if( shared.second )
+                    pool.insert( pool.end(), field.begin(), field.end() );
+                fields.push_back( encode( value, pool, shared.first->second, field.size() ) );
+            }
+            record.count = ( uint32_t )fields.size() - record.first;
+            record.offset = record.size = 0;
+        }
     }
-    else if( type == L"Raster" )
+    catch( ... )
     {
-        object = std::make_shared<Raster>();
-        auto raster = dynamic_cast<Raster*>( object.get() );
-        makeException( raster );
-        image = raster->image.get();
+        return false;
     }
-    else if( type == L"Line" )
+
+    DocumentHeader header;
+    std::memcpy( header.magic, documentMagic, sizeof( documentMagic ) );
+    header.version = documentVersion;
+    header.records = ( uint32_t )records.size();
+    header.fields = ( uint32_t )fields.size();
+    header.pool = pool.size();
+
+    // Rasters may be mapped from the file being replaced, so it is written aside under an unused name and renamed
+    std::error_code error;
+    std::filesystem::path temporary;
+    int attempt = 0;
+    do
     {
-        object = std::make_shared<Line>();
+        temporary = path;
+        temporary += L"." + std::to_wstring( attempt++ ) + L".tmp";
     }
-    else if( type == L"Rectangle" )
+    while( std::filesystem::exists( temporary, error ) );
+
+    std::ofstream file( temporary, std::ios::binary );
+    if( !file )
+        return false;
+
+    auto write = [&]( const void * data, uint64_t size )
+    {
+        if( size )
+            file.write( ( const char * )data, size );
+    };
+
+    // Records get offsets and sizes of rasters after those are written, they are rewritten then
+    write( &header, sizeof( header ) );
+    write( records.data(), records.size() * sizeof( DocumentRecord ) );
+    write( fields.data(), fields.size() * sizeof( DocumentField ) );
+    write( pool.data(), pool.size() * sizeof( uint32_t ) );
+
+    // Unchanged rasters are copied from their documents, others are compressed straight into the file
+    std::vector<char> padding( Raw::page, 0 );
+    uint64_t end = ( uint64_t )file.tellp();
+    for( size_t k = 0; k < entities.size() && file; ++k )
     {
-        object = std::make_shared<Rectangle>();
+        auto raster = dynamic_cast<const Raster*>( entities[k] );
+        if( !raster )
+            continue;
+
+        records[k].offset = roundUp( end, Raw::page );
+        write( padding.data(), records[k].offset - end );
+
+        auto source = raster->container( records[k].size );
+        if( source )
+            write( source, records[k].size );
+        else if( Raw::write( file, *raster->image, Raw::Compression::fast ) )
+            records[k].size = ( uint64_t )file.tellp() - records[k].offset;
+        else
+            file.setstate( std::ios::failbit );
+        end = records[k].offset + records[k].size;
     }
-    else if( type == L"Circle" )
+
+    file.seekp( sizeof( header ) );
+    write( records.data(), records.size() * sizeof( DocumentRecord ) );
+    file.close();
+    if( !file )
     {
-        object = std::make_shared<Circle>();
+        std::filesystem::remove( temporary, error );
+        return false;
     }
-    else if( type == L"Text" )
+
+    // Nothing may map the replaced file, rasters kept elsewhere, in the journal for one, are decoded into memory,
+    // rasters of the tree let their containers go until the file is renamed
+    struct Place
+    {
+        Raster *raster;
+        uint64_t offset, size;
+    };
+    std::vector<Place> places;
+    std::set<const Entity*> tree( entities.begin(), entities.end() );
+    for( auto raster : Raster::all() )
     {
-        object = std::make_shared<Text>();
+        Place place{ raster, 0, 0 };
+        if( !raster->storedIn( path, place.offset, place.size ) )
+            continue;
+
+        if( tree.count( raster ) )
+            places.push_back( place );
+        else
+            raster->pixels();
+        raster->unbind();
     }
-    else if( type == L"Point" )
+
+    std::filesystem::rename( temporary, path, error );
+    if( error )
     {
-        object = std::make_shared<Point>();
+        std::filesystem::remove( temporary, error );
+        auto old = std::make_shared<const Raw::Mapping>( path );
+        for( auto& place : places )
+            place.raster->store( old, place.offset, place.size );
+        return false;
     }
-    else
+
+    // Rasters of the tree switch to the new file
+    auto mapping = std::make_shared<const Raw::Mapping>( path );
+    for( size_t k = 0; k < entities.size(); ++k )
     {
-        makeException( false );
+        if( records[k].size )
+            const_cast<Raster*>( dynamic_cast<const Raster*>( entities[k] ) )->store( mapping, records[k].offset, records[k].size );
+    }
+    return mapping->size() == end;
+}
+
+static std::shared_ptr<Entity> read( const std::shared_ptr<const Raw::Mapping>& mapping )
+{
+    auto bytes = mapping->data();
+    uint64_t size = mapping->size();
+
+    DocumentHeader header;
+    makeException( size >= sizeof( header ) );
+    std::memcpy( &header, bytes, sizeof( header ) );
+    makeException( !std::memcmp( header.magic, documentMagic, sizeof( documentMagic ) ) && header.version == documentVersion && header.records );
+
+    uint64_t tables = sizeof( header ) + ( uint64_t )header.records * sizeof( DocumentRecord ) + ( uint64_t )header.fields * sizeof( DocumentField );
+    makeException( tables <= size && header.pool <= ( size - tables ) / sizeof( uint32_t ) );
+
+    std::vector<DocumentRecord> records( header.records );
+    std::vector<DocumentField> fields( header.fields );
+    std::vector<uint32_t> pool( header.pool );
+    auto p = bytes + sizeof( header );
+    std::memcpy( records.data(), p, records.size() * sizeof( DocumentRecord ) );
+    p += records.size() * sizeof( DocumentRecord );
+    if( !fields.empty() )
+        std::memcpy( fields.data(), p, fields.size() * sizeof( DocumentField ) );
+    p += fields.size() * sizeof( DocumentField );
+    if( !pool.empty() )
+        std::memcpy( pool.data(), p, pool.size() * sizeof( uint32_t ) );
+
+    std::vector<std::shared_ptr<Entity>> entities( records.size() );
+    for( size_t k = 0; k < records.size(); ++k )
+    {
+        auto& record = records[k];
+        makeException( record.type < std::size( entityTypes ) );
+        makeException( k ? record.parent >= 0 && ( size_t )record.parent < k : record.parent == -1 );
+        makeException( record.first <= fields.size() && record.count <= fields.size() - record.first );
+
+        auto object = create( entityTypes[record.type] );
+        // Fields unknown to the entity are skipped, missing ones keep their defaults
+        auto data = object->deserializationData();
+        for( size_t i = 0; i < data.size(); ++i )
+        {
+            auto f = find( fields, record, std::get<0>( data[i] ), pool );
+            if( f )
+                decode( *f, std::get<1>( data[i] ), pool.data(), pool.size() );
+        }
+
+        // Only headers of rasters are checked here, pixels are decoded when rasters are drawn
+        auto raster = dynamic_cast<Raster*>( object.get() );
+        makeException( !raster == !record.size );
+        if( raster )
+        {
+            makeException( Raw::View( mapping, record.offset, record.size ).valid() );
+            raster->store( mapping, record.offset, record.size );
+        }
+
+        if( k )
+            entities[record.parent]->add( object );
+        entities[k] = std::move( object );
     }
 
+    return entities.front();
+}
+
+static std::shared_ptr<Entity> extract( const Information::Item & storage, const std::filesystem::path& path )
+{
+    using namespace Information;
+
+    auto object = create( ( std::wstring )storage( L"class" ).as<String>() );
+    makeException( object != nullptr );
+
+    auto raster = dynamic_cast<Raster*>( object.get() );
+    ImageDataBase *image = raster ? raster->image.get() : nullptr;
+
     for( auto& [nameOriginal, value] : object->deserializationData() )
     {
         auto name = MetaData::fixName( nameOriginal );
@@ -564,6 +878,20 @@ std::shared_ptr<Entity> Entity::load( const std::filesystem::path& path )
 {
     using namespace Information;
 
+    auto mapping = std::make_shared<const Raw::Mapping>( path );
+    if( mapping->size() >= sizeof( documentMagic ) && !std::memcmp( mapping->data(), documentMagic, sizeof( documentMagic ) ) )
+    {
+        try
+        {
+            return read( mapping );
+        }
+        catch( ... )
+        {}
+        return nullptr;
+    }
+    mapping.reset();
+
+    // Documents saved before the binary format are information trees with rasters beside them
     Item self;
     if( !self.input( path ) )
         return nullptr;
@@ -680,16 +1008,203 @@ bool Group::isComplex() const
     return true;
 }
 
-Raster::Raster() : Entity(), image( std::make_shared<ImageData>() )
-{}
+// Stored rasters with decoded pixels, rasters are drawn and edited on one thread
+static std::vector<Raster*> residents;
+static size_t residentBytes = 0, residentBudget = ( size_t )1 << 30;
+static uint64_t residentClock = 0;
+static std::vector<Raster*> rasters;
 
-Raster::Raster( std::wstring n, int64_t width, int64_t height, const Position& p ) : Entity( std::move( n ), p ), image( std::make_shared<ImageData>() ), w( width ), h( height )
-{}
+Raster::Raster() : Entity(), source( nullptr ), sourceW( 0 ), sourceH( 0 ), storedOffset( 0 ), storedSize( 0 ), footprint( 0 ), used( 0 ), decoded( false ), image( std::make_shared<ImageData>() )
+{
+    rasters.push_back( this );
+}
+
+Raster::Raster( std::wstring n, int64_t width, int64_t height, const Position& p ) :
+    Entity( std::move( n ), p ), source( nullptr ), sourceW( 0 ), sourceH( 0 ), storedOffset( 0 ), storedSize( 0 ), footprint( 0 ), used( 0 ), decoded( false ),
+    image( std::make_shared<ImageData>() ), w( width ), h( height )
+{
+    rasters.push_back( this );
+}
+
+Raster::~Raster()
+{
+    release();
+    rasters.erase( std::find( rasters.begin(), rasters.end(), this ) );
+}
+
+void Raster::invalidate()
+{
+    levels.clear();
+    source = nullptr;
+    release();
+    stored.reset();
+}
+
+void Raster::admit()
+{
+    decoded = true;
+    used = ++residentClock;
+    footprint = ( size_t )image->w() * image->h() * sizeof( Pixel );
+    residents.push_back( this );
+    residentBytes += footprint;
+    trim( this );
+}
+
+// Leaves the budget, pixels stay in memory
+void Raster::release()
+{
+    if( !decoded )
+        return;
+
+    residents.erase( std::find( residents.begin(), residents.end(), this ) );
+    residentBytes -= footprint;
+    footprint = 0;
+    decoded = false;
+}
+
+void Raster::evict()
+{
+    release();
+    levels.clear();
+    source = nullptr;
+    image = std::make_shared<ImageData>();
+}
+
+void Raster::trim( const Raster *keep )
+{
+    while( residentBytes > residentBudget )
+    {
+        Raster *oldest = nullptr;
+        for( auto r : residents )
+        {
+            if( r != keep && ( !oldest || r->used < oldest->used ) )
+                oldest = r;
+        }
+
+        if( !oldest )
+            break;
+        oldest->evict();
+    }
+}
+
+void Raster::store( std::shared_ptr<const Raw::Mapping> mapping, uint64_t offset, uint64_t size )
+{
+    stored = std::move( mapping );
+    storedOffset = offset;
+    storedSize = size;
+
+    // Pixels already in memory are the decoded container now
+    if( !decoded && image->w() && image->h() )
+        admit();
+}
+
+const unsigned char *Raster::container( uint64_t& size ) const
+{
+    size = storedSize;
+    return stored ? stored->data() + storedOffset : nullptr;
+}
+
+bool Raster::storedIn( const std::filesystem::path& document, uint64_t& offset, uint64_t& size ) const
+{
+    std::error_code error;
+    if( !stored || !std::filesystem::equivalent( stored->source(), document, error ) )
+        return false;
+
+    offset = storedOffset;
+    size = storedSize;
+    return true;
+}
+
+void Raster::unbind()
+{
+    release();
+    stored.reset();
+}
+
+const std::vector<Raster*>& Raster::all()
+{
+    return rasters;
+}
+
+ImageDataBase &Raster::pixels()
+{
+    if( decoded )
+    {
+        used = ++residentClock;
+    }
+    else if( stored )
+    {
+        // Damaged containers leave the raster empty, drawing fills it then
+        Raw::View view( stored, storedOffset, storedSize );
+        if( view.valid() && view.read( *image ) )
+        {
+            admit();
+        }
+        else
+        {
+            image->reset( 0, 0 );
+            stored.reset();
+        }
+    }
+    return *image;
+}
+
+const ImageDataBase &Raster::pixels() const
+{
+    return const_cast<Raster*>( this )->pixels();
+}
+
+void Raster::replace( std::shared_ptr<ImageDataBase> other )
+{
+    invalidate();
+    image = std::move( other );
+}
+
+void Raster::budget( size_t bytes )
+{
+    residentBudget = bytes;
+    trim( nullptr );
+}
+
+size_t Raster::budget()
+{
+    return residentBudget;
+}
+
+const ImageDataBase &Raster::level( double scale ) const
+{
+    if( source != image.get() || sourceW != image->w() || sourceH != image->h() )
+    {
+        levels.clear();
+        source = image.get();
+        sourceW = image->w();
+        sourceH = image->h();
+    }
+
+    // The coarsest level, which pixels still cover at most one canvas pixel
+    const ImageDataBase *current = image.get();
+    for( size_t k = 0; 2 * scale <= 1 && ( current->w() > 1 || current->h() > 1 ); ++k )
+    {
+        if( k == levels.size() )
+        {
+            auto next = std::make_shared<ImageData>();
+            Resample::resize( *current, *next, Max( current->w() / 2, 1 ), Max( current->h() / 2, 1 ), Resample::Filter::box );
+            levels.push_back( next );
+        }
+
+        current = levels[k].get();
+        scale *= 2;
+    }
+    return *current;
+}
 
 Entity *Raster::pointsTo( const Affine2D& transform, const Vector2D& point, SelectionMode mode )
 {
+    double width = Max( Abs( w ), 1 );
+    double height = Max( Abs( h ), 1 );
+
     auto p = transform.inv()( point );
-    if( !( 0 <= p.x && p.x <= image->w() && 0 <= p.y && p.y <= image->h() ) )
+    if( !( 0 <= p.x && p.x <= width && 0 <= p.y && p.y <= height ) )
         return nullptr;
 
     for( auto i = nodes.rbegin(); i != nodes.rend(); ++i )
@@ -705,18 +1220,44 @@ Entity *Raster::pointsTo( const Affine2D& transform, const Vector2D& point, Sele
 
 bool Raster::draw( const Affine2D& transform, Overlap::Canvas& canvas ) const
 {
-    image->crop( *image, 0, 0, Max( Abs( w ), 1 ), Max( Abs( h ), 1 ), ( Pixel )fill );
+    // Rasters outside of the canvas are neither decoded nor drawn
+    Vector2D topLeft, bottomRight;
+    size( transform, topLeft, bottomRight );
+    if( bottomRight.x < 0 || bottomRight.y < 0 || topLeft.x > canvas.width() || topLeft.y > canvas.height() )
+        return true;
+
+    // Drawing nodes may evict the pixels, the local reference keeps them until the end
+    pixels();
+    auto pinned = image;
+
+    int width = Max( Abs( w ), 1 ), height = Max( Abs( h ), 1 );
+    if( pinned->w() != width || pinned->h() != height )
+    {
+        auto cropped = std::make_shared<ImageData>();
+        pinned->crop( *cropped, 0, 0, width, height, ( Pixel )fill );
+        const_cast<Raster*>( this )->replace( cropped );
+        pinned = std::move( cropped );
+    }
 
-    Overlap::Canvas self( *image );
+    // Nodes are drawn in image pixels, so rasters with nodes stay at full resolution
+    const ImageDataBase *picture = pinned.get();
+    if( nodes.empty() )
+    {
+        auto origin = transform( Vector2D( 0, 0 ) );
+        auto scale = Max( ( transform( Vector2D( 1, 0 ) ) - origin ).Abs(), ( transform( Vector2D( 0, 1 ) ) - origin ).Abs() );
+        picture = &level( scale );
+    }
+
+    Overlap::Canvas self( *picture );
     for( auto& node : nodes )
     {
         if( !node->draw( node->position(), self ) )
             return false;
     }
 
-    Overlap::Picture picture( self );
-    picture.set( transform );
-    canvas.draw( picture );
+    Overlap::Picture result( self );
+    result.set( transform * Affine2D( Matrix2D::Scale( ( double )width / picture->w(), ( double )height / picture->h() ) ) );
+    canvas.draw( result );
     canvas.bake();
     return true;
 }
@@ -7,6 +7,11 @@
 #include "Affine2D.h"
 #include "Overlap.h"
 
+namespace Raw
+{
+class Mapping;
+}
+
 namespace JustEdit
 {
 class Position
@@ -51,6 +56,8 @@ public:
     std::wstring description() const;
 
     Entity *add( std::shared_ptr<Entity> node );
+    // At position index among nodes, at the end for larger indices
+    Entity *insert( std::shared_ptr<Entity> node, size_t index );
     std::shared_ptr<Entity> remove( const Entity* node );
     std::shared_ptr<Entity> detach();
 
@@ -103,12 +110,58 @@ public:
 
 class Raster : public Entity
 {
+private:
+    // Halved copies of the image, built on demand, when the raster is drawn zoomed out
+    mutable std::vector<std::shared_ptr<ImageDataBase>> levels;
+    mutable const ImageDataBase *source;
+    mutable int sourceW, sourceH;
+
+    // Container of the pixels in a mapped document, forgotten once the pixels change
+    std::shared_ptr<const Raw::Mapping> stored;
+    uint64_t storedOffset, storedSize;
+    // Decoded pixels of stored rasters count against the budget, the least recently used are dropped
+    size_t footprint;
+    uint64_t used;
+    bool decoded;
+
+    const ImageDataBase &level( double scale ) const;
+    void admit();
+    void release();
+    void evict();
+    static void trim( const Raster *keep );
 public:
+    // Pixels of stored rasters are decoded by pixels, read them through it
     std::shared_ptr<ImageDataBase> image;
     int64_t w, h;
 
     Raster();
     Raster( std::wstring name, int64_t w, int64_t h, const Position& position = Position() );
+    Raster( const Raster& ) = delete;
+    Raster& operator=( const Raster& ) = delete;
+    virtual ~Raster();
+
+    // Drops the halved copies and the stored container, has to be called after pixels of the image change
+    void invalidate();
+
+    // Binds pixels to a raw container in a mapped document, they are decoded on first use
+    void store( std::shared_ptr<const Raw::Mapping> mapping, uint64_t offset, uint64_t size );
+    // Stored container of unchanged pixels, nullptr otherwise
+    const unsigned char *container( uint64_t& size ) const;
+    // Whether the stored container is in the document, and where
+    bool storedIn( const std::filesystem::path& document, uint64_t& offset, uint64_t& size ) const;
+    // Lets the stored container go, pixels already decoded stay in memory out of the budget
+    void unbind();
+    // Every raster in existence, those kept outside documents included
+    static const std::vector<Raster*>& all();
+
+    ImageDataBase &pixels();
+    const ImageDataBase &pixels() const;
+    // Pixels are swapped, not written, so buffers kept by the undo journal stay as they are
+    void replace( std::shared_ptr<ImageDataBase> other );
+
+    // Bytes of decoded pixels of all stored rasters kept in memory, 1 GB by default
+    static void budget( size_t bytes );
+    static size_t budget();
 
     virtual Entity *pointsTo( const Affine2D& transform, const Vector2D& point, SelectionMode mode ) override;
 
@@ -1,5 +0,0 @@
-#pragma once
-
-#include "ImageData.h"
-
-void Outline( const ImageData &in, ImageData &out );
@@ -2,7 +2,9 @@
 
 #include <vector>
 
+#include "Composite.h"
 #include "Basic.h"
+
 namespace Overlap
 {
 Picture::Picture( const Canvas &canvas ) :
@@ -71,7 +73,7 @@ void PixelObject::bake()
     clear();
 }
 
-Color PixelObject::calculate()
+Color PixelObject::coverage() const
 {
     Color result( 0, 0, 0, 0 );
     for( const auto &o : overlaping )
@@ -81,13 +83,30 @@ Color PixelObject::calculate()
         result.b += o.color.b * o.color.a * o.area;
         result.a += o.color.a * o.area;
     }
-    if( result.a > 0 )
+    return result;
+}
+
+// Coverage as a premultiplied pixel
+static Pixel premultiplied( const Color &c )
+{
+    auto a = Min( Max( c.a, 0.0 ), 1.0 );
+    auto channel = [a]( double v )
     {
-        result.r /= result.a;
-        result.g /= result.a;
-        result.b /= result.a;
-    }
-    return result = color.layer( result );
+        return ( unsigned char )Round( Min( Max( v, 0.0 ), a ) * 255 );
+    };
+    return Pixel( channel( c.r ), channel( c.g ), channel( c.b ), channel( a ) );
+}
+
+// Same integer arithmetic as Canvas::render, so baked layers and rendered ones are equal
+Color PixelObject::calculate()
+{
+    auto source = premultiplied( coverage() );
+    if( !source.a )
+        return color;
+
+    auto destination = Composite::premultiply( ( Pixel )color );
+    Composite::row( Composite::Operator::over, &source, &destination, 1 );
+    return ( Color )Composite::unpremultiply( destination );
 }
 
 void PixelObject::clear()
@@ -434,9 +453,26 @@ void Canvas::render( ImageDataBase &out )
     if( out.w() != w || out.h() != h )
         out.reset( w, h );
 
-    apply( [&out]( int j, int i, PixelObject & pixel )
+    // Coverage and the pixel below are composed as premultiplied rows, pixels without coverage are kept as they are
+    Parallel::rows( h, [&]( int begin, int end )
     {
-        *out( j, i ) = ( Pixel )pixel.calculate();
+        std::vector<Pixel> source( w ), below( w ), destination( w );
+        for( int i = begin; i < end; ++i )
+        {
+            for( int j = 0; j < w; ++j )
+            {
+                auto &pixel = operator()( j, i );
+                source[j] = premultiplied( pixel.coverage() );
+                below[j] = ( Pixel )pixel.color;
+                destination[j] = Composite::premultiply( below[j] );
+            }
+
+            Composite::row( Composite::Operator::over, source.data(), destination.data(), w );
+
+            auto o = out( 0, i );
+            for( int j = 0; j < w; ++j )
+                o[j] = source[j].a ? Composite::unpremultiply( destination[j] ) : below[j];
+        }
     } );
 }
 
@@ -107,6 +107,8 @@ public:
 
     void draw( const Color &color, double area );
     void bake();
+    // Premultiplied sum of overlaps weighted by their areas
+    Color coverage() const;
     Color calculate();
     void clear();
 };
@@ -1,22 +1,158 @@
 #include "Palette.h"
 
-void Palette::add( const Pixel &c )
+#include <algorithm>
+#include <cstdio>
+#include <tuple>
+
+#include "Lambda.h"
+
+uint32_t Palette::pack( const Pixel &c )
+{
+    return c.b | ( c.g << 8 ) | ( c.r << 16 ) | ( ( uint32_t )c.a << 24 );
+}
+
+Pixel Palette::unpack( uint32_t key )
+{
+    return Pixel( ( key >> 16 ) & 0xFF, ( key >> 8 ) & 0xFF, key & 0xFF, key >> 24 );
+}
+
+size_t Palette::slot( uint32_t key ) const
+{
+    size_t mask = keys.size() - 1;
+    size_t k = ( ( key * 0x9E3779B97F4A7C15ull ) >> 32 ) & mask;
+    while( counts[k] != 0 && keys[k] != key )
+        k = ( k + 1 ) & mask;
+    return k;
+}
+
+void Palette::grow()
+{
+    std::vector<uint32_t> oldKeys( Max<size_t>( keys.size() * 2, 64 ) );
+    std::vector<uint64_t> oldCounts( oldKeys.size(), 0 );
+    keys.swap( oldKeys );
+    counts.swap( oldCounts );
+
+    for( size_t k = 0; k < oldKeys.size(); ++k )
+    {
+        if( oldCounts[k] != 0 )
+        {
+            auto s = slot( oldKeys[k] );
+            keys[s] = oldKeys[k];
+            counts[s] = oldCounts[k];
+        }
+    }
+}
+
+void Palette::add( const Pixel &c, uint64_t count )
+{
+    if( count == 0 )
+        return;
+
+    // At most half of the slots are used
+    if( 2 * ( used + 1 ) > keys.size() )
+        grow();
+
+    auto key = pack( c );
+    auto s = slot( key );
+    if( counts[s] == 0 )
+    {
+        keys[s] = key;
+        ++used;
+    }
+    counts[s] += count;
+}
+
+void Palette::add( const ImageDataBase &image )
+{
+    int w = image.w(), h = image.h();
+    if( w <= 0 || h <= 0 )
+        return;
+
+    auto last = pack( *image( 0, 0 ) );
+    uint64_t run = 0;
+
+    for( int i = 0; i < h; ++i )
+    {
+        auto p = image( 0, i );
+        for( int j = 0; j < w; ++j )
+        {
+            auto key = pack( p[j] );
+            if( key != last )
+            {
+                add( unpack( last ), run );
+                last = key;
+                run = 0;
+            }
+            ++run;
+        }
+    }
+
+    add( unpack( last ), run );
+}
+
+void Palette::merge( const Palette &other )
 {
-    colors.insert( c );
+    for( size_t k = 0; k < other.keys.size(); ++k )
+    {
+        if( other.counts[k] != 0 )
+            add( unpack( other.keys[k] ), other.counts[k] );
+    }
 }
 
 bool Palette::contains( const Pixel &c ) const
 {
-    return colors.find( c ) != colors.end();
+    return count( c ) != 0;
+}
+
+uint64_t Palette::count( const Pixel &c ) const
+{
+    if( keys.empty() )
+        return 0;
+    return counts[slot( pack( c ) )];
 }
 
 unsigned Palette::size() const
 {
-    return colors.size();
+    return used;
+}
+
+std::vector<std::pair<Pixel, uint64_t>> Palette::sorted() const
+{
+    std::vector<std::pair<uint32_t, uint64_t>> entries;
+    entries.reserve( used );
+    for( size_t k = 0; k < keys.size(); ++k )
+    {
+        if( counts[k] != 0 )
+            entries.emplace_back( keys[k], counts[k] );
+    }
+
+    std::sort( entries.begin(), entries.end(), []( const auto & e0, const auto & e1 )
+    {
+        return e0.second != e1.second ? e0.second > e1.second : e0.first < e1.first;
+    } );
+
+    std::vector<std::pair<Pixel, uint64_t>> result;
+    result.reserve( entries.size() );
+    for( auto &e : entries )
+        result.emplace_back( unpack( e.first ), e.second );
+    return result;
 }
 
 std::string Palette::out() const
 {
+    std::vector<Pixel> colors;
+    colors.reserve( used );
+    for( size_t k = 0; k < keys.size(); ++k )
+    {
+        if( counts[k] != 0 )
+            colors.push_back( unpack( keys[k] ) );
+    }
+
+    std::sort( colors.begin(), colors.end(), []( const Pixel & c0, const Pixel & c1 )
+    {
+        return std::tie( c0.r, c0.g, c0.b, c0.a ) < std::tie( c1.r, c1.g, c1.b, c1.a );
+    } );
+
     std::string result;
     for( auto i = colors.begin(); i != colors.end(); ++i )
     {
@@ -32,3 +168,31 @@ std::string Palette::out() const
     }
     return result;
 }
+
+bool Palette::out( const std::filesystem::path &path ) const
+{
+    Finalizer _;
+
+    std::filesystem::create_directories( path.parent_path() );
+
+    FILE *f = _wfopen( path.c_str(), L"wb" );
+    if( !f )
+        return false;
+
+    _.push( [f]()
+    {
+        fclose( f );
+    } );
+
+    uint32_t n = used;
+    if( fwrite( &n, sizeof( n ), 1, f ) != 1 )
+        return false;
+
+    for( auto &entry : sorted() )
+    {
+        if( fwrite( &entry.first, sizeof( entry.first ), 1, f ) != 1 ||
+                fwrite( &entry.second, sizeof( entry.second ), 1, f ) != 1 )
+            return false;
+    }
+    return true;
+}
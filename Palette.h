@@ -1,25 +1,44 @@
 #pragma once
 
+#include <filesystem>
+#include <cstdint>
+#include <utility>
 #include <string>
-#include <set>
+#include <vector>
 
 #include "ImageDataBase.h"
 
+// Set of colors with occurrence counts, open addressing on packed BGRA values
 class Palette
 {
 private:
-    class Compare
-    {
-    public:
-        bool operator()( const Pixel &c0, const Pixel &c1 ) const
-        {
-            return ( c0.r < c1.r ) || ( ( c0.r == c1.r ) && ( c0.g < c1.g ) ) || ( ( c0.r == c1.r ) && ( c0.g == c1.g ) && ( c0.b < c1.b ) ) || ( ( c0.r == c1.r ) && ( c0.g == c1.g ) && ( c0.b == c1.b ) && ( c0.a < c1.a ) );
-        }
-    };
-    std::set<Pixel, Compare> colors;
+    std::vector<uint32_t> keys;
+    std::vector<uint64_t> counts; // 0 marks an empty slot
+    unsigned used = 0;
+
+    size_t slot( uint32_t key ) const;
+    void grow();
 public:
-    void add( const Pixel &c );
+    static uint32_t pack( const Pixel &c );
+    static Pixel unpack( uint32_t key );
+
+    void add( const Pixel &c, uint64_t count = 1 );
+
+    // Counts every pixel, runs of equal pixels are counted at once
+    void add( const ImageDataBase &image );
+
+    // Palettes collected by different threads can be combined afterwards
+    void merge( const Palette &other );
+
     bool contains( const Pixel &c ) const;
+    uint64_t count( const Pixel &c ) const;
     unsigned size() const;
+
+    // Most frequent colors first
+    std::vector<std::pair<Pixel, uint64_t>> sorted() const;
+
     std::string out() const;
+
+    // Binary palette: uint32 color count, then BGRA bytes and uint64 count of every color, most frequent first
+    bool out( const std::filesystem::path &path ) const;
 };
@@ -0,0 +1,169 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Basic.h"
+
+namespace Parallel
+{
+Pool::Batch::Batch( const std::function<void( size_t )> &function, size_t c ) : f( &function ), count( c ), next( 0 ), done( 0 )
+{}
+
+Pool::Pool( unsigned threads ) : stop( false )
+{
+    workers.reserve( threads );
+    for( unsigned k = 0; k < threads; ++k )
+        workers.emplace_back( [this]()
+    {
+        loop();
+    } );
+}
+
+Pool::~Pool()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stop = true;
+    }
+    wake.notify_all();
+
+    for( auto &worker : workers )
+        worker.join();
+}
+
+Pool &Pool::shared()
+{
+    // The calling thread takes part in every batch, so one thread less is started
+    static Pool pool( Max( std::thread::hardware_concurrency(), 1u ) - 1 );
+    return pool;
+}
+
+unsigned Pool::size() const
+{
+    return workers.size() + 1;
+}
+
+bool Pool::execute( Batch &batch )
+{
+    auto k = batch.next++;
+    if( k >= batch.count )
+        return false;
+
+    try
+    {
+        ( *batch.f )( k );
+    }
+    catch( ... )
+    {
+        std::lock_guard<std::mutex> lock( batch.errorMutex );
+        if( !batch.error )
+            batch.error = std::current_exception();
+    }
+
+    if( ++batch.done == batch.count )
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        finished.notify_all();
+    }
+    return true;
+}
+
+void Pool::loop()
+{
+    for( ;; )
+    {
+        std::shared_ptr<Batch> batch;
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            wake.wait( lock, [this]()
+            {
+                return stop || !queue.empty();
+            } );
+
+            if( stop )
+                return;
+
+            batch = queue.front();
+            if( batch->next >= batch->count )
+            {
+                queue.pop_front();
+                continue;
+            }
+        }
+
+        while( execute( *batch ) )
+        {}
+    }
+}
+
+void Pool::run( size_t count, const std::function<void( size_t )> &f )
+{
+    if( count == 0 )
+        return;
+
+    if( count == 1 || workers.empty() )
+    {
+        for( size_t k = 0; k < count; ++k )
+            f( k );
+        return;
+    }
+
+    auto batch = std::make_shared<Batch>( f, count );
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        queue.push_back( batch );
+    }
+    wake.notify_all();
+
+    while( execute( *batch ) )
+    {}
+
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+
+        auto i = std::find( queue.begin(), queue.end(), batch );
+        if( i != queue.end() )
+            queue.erase( i );
+
+        finished.wait( lock, [&batch]()
+        {
+            return batch->done >= batch->count;
+        } );
+    }
+
+    if( batch->error )
+        std::rethrow_exception( batch->error );
+}
+
+unsigned threads()
+{
+    return Pool::shared().size();
+}
+
+void tasks( size_t count, const std::function<void( size_t )> &f )
+{
+    Pool::shared().run( count, f );
+}
+
+void rows( int count, const std::function<void( int, int )> &f )
+{
+    if( count <= 0 )
+        return;
+
+    // A few bands per thread even out rows of different cost
+    int n = Min( ( int )threads() * 4, count );
+    if( n <= 1 )
+    {
+        f( 0, count );
+        return;
+    }
+
+    tasks( n, [&f, count, n]( size_t k )
+    {
+        int begin = ( int )( ( long long )count * k / n );
+        int end = ( int )( ( long long )count * ( k + 1 ) / n );
+        f( begin, end );
+    } );
+}
+}
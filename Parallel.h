@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <deque>
+
+// Marks a per-pixel function as free of side effects, so it can be applied to rows concurrently
+template<typename F>
+class Pure
+{
+public:
+    F f;
+
+    Pure( F function ) : f( std::move( function ) )
+    {}
+};
+
+template<typename F>
+inline Pure<F> pure( F f )
+{
+    return Pure<F>( std::move( f ) );
+}
+
+namespace Parallel
+{
+// Threads shared by every parallel algorithm
+// A thread waiting for its batch executes units of that batch itself, so batches may be nested
+class Pool
+{
+private:
+    struct Batch
+    {
+        const std::function<void( size_t )> *f;
+        size_t count;
+        std::atomic<size_t> next, done;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        Batch( const std::function<void( size_t )> &function, size_t c );
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<std::shared_ptr<Batch>> queue;
+    std::condition_variable wake, finished;
+    std::mutex mutex;
+    bool stop;
+
+    Pool( unsigned threads );
+
+    bool execute( Batch &batch );
+    void loop();
+public:
+    static Pool &shared();
+
+    Pool( const Pool & ) = delete;
+    Pool &operator=( const Pool & ) = delete;
+    ~Pool();
+
+    unsigned size() const;
+
+    // Calls f( k ) for every k in [0, count), returns when all calls are finished
+    void run( size_t count, const std::function<void( size_t )> &f );
+};
+
+unsigned threads();
+
+// Independent units of work, results must not depend on the order of execution
+void tasks( size_t count, const std::function<void( size_t )> &f );
+
+// Splits [0, count) into contiguous bands and calls f( begin, end ) for each band
+void rows( int count, const std::function<void( int, int )> &f );
+}
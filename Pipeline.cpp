@@ -0,0 +1,258 @@
+#include "Pipeline.h"
+
+#include "Exception.h"
+#include "Basic.h"
+
+#include "ImageData.h"
+
+Pipeline::Node::Node( Type t ) : type( t ), shift{ 0, 0, 0, 0, 0, 0 }
+{}
+
+Pipeline::Pipeline( const ImageDataBase &s ) : tileSize( 64 ), source( s )
+{}
+
+Pipeline &Pipeline::function( const PixelFunction &f )
+{
+    auto &node = nodes.emplace_back( Node::Type::pixel );
+    node.pixel = f;
+    return *this;
+}
+
+Pipeline &Pipeline::function( const ColorFunction &f )
+{
+    auto &node = nodes.emplace_back( Node::Type::color );
+    node.color = f;
+    return *this;
+}
+
+Pipeline &Pipeline::invert()
+{
+    nodes.emplace_back( Node::Type::invert );
+    return *this;
+}
+
+Pipeline &Pipeline::shiftRGB( int rx, int ry, int gx, int gy, int bx, int by )
+{
+    auto &node = nodes.emplace_back( Node::Type::shift );
+    node.shift[0] = rx;
+    node.shift[1] = ry;
+    node.shift[2] = gx;
+    node.shift[3] = gy;
+    node.shift[4] = bx;
+    node.shift[5] = by;
+    return *this;
+}
+
+Pipeline &Pipeline::convolution( const Filters::Convolution &params )
+{
+    auto &node = nodes.emplace_back( Node::Type::convolution );
+    node.params = params;
+    return *this;
+}
+
+size_t Pipeline::size() const
+{
+    return nodes.size();
+}
+
+void Pipeline::clear()
+{
+    nodes.clear();
+}
+
+// Pixel ( j, i ) of in, or its channels gathered from shifted positions
+static Pixel gathered( const ImageDataBase &in, const int *shift, int j, int i )
+{
+    if( !shift )
+        return *in( j, i );
+
+    Pixel p( 0, 0, 0 );
+
+    auto channel = [&]( int dx, int dy ) -> const Pixel *
+    {
+        int x = j - dx;
+        int y = i - dy;
+        if( x < 0 || y < 0 || x >= in.w() || y >= in.h() )
+            return nullptr;
+        return in( x, y );
+    };
+
+    if( auto c = channel( shift[0], shift[1] ) )
+        p.r = c->r;
+    if( auto c = channel( shift[2], shift[3] ) )
+        p.g = c->g;
+    if( auto c = channel( shift[4], shift[5] ) )
+        p.b = c->b;
+
+    return p;
+}
+
+void Pipeline::size( const ImageDataBase &in, const Node *gather, int &w, int &h )
+{
+    w = in.w();
+    h = in.h();
+
+    if( gather )
+    {
+        auto shift = gather->shift;
+        w += Max( Max( Max( shift[0], shift[2] ), shift[4] ), 0 );
+        h += Max( Max( Max( shift[1], shift[3] ), shift[5] ), 0 );
+    }
+}
+
+void Pipeline::apply( const Node *begin, const Node *end, int w, int h, int j0, int j1, int i0, int i1, Pixel *tile )
+{
+    for( auto node = begin; node != end; ++node )
+    {
+        auto p = tile;
+        switch( node->type )
+        {
+        case Node::Type::pixel:
+            for( int i = i0; i < i1; ++i )
+            {
+                for( int j = j0; j < j1; ++j )
+                {
+                    Pixel z = *p;
+                    node->pixel( w, h, j, i, *p, z );
+                    *p++ = z;
+                }
+            }
+            break;
+        case Node::Type::color:
+            for( int i = i0; i < i1; ++i )
+            {
+                for( int j = j0; j < j1; ++j )
+                {
+                    auto c = ( Color ) * p;
+                    Color z = c;
+                    node->color( ( j + 0.5 ) / w - 0.5, ( i + 0.5 ) / h - 0.5, c, z );
+                    *p++ = ( Pixel )z;
+                }
+            }
+            break;
+        case Node::Type::invert:
+            for( int i = i0; i < i1; ++i )
+            {
+                for( int j = j0; j < j1; ++j )
+                {
+                    *p = p->invert();
+                    ++p;
+                }
+            }
+            break;
+        case Node::Type::shift:
+        case Node::Type::convolution:
+        default:
+            makeException( false );
+            break;
+        }
+    }
+}
+
+void Pipeline::segment( const ImageDataBase &in, const Node *gather, const Node *begin, const Node *end, ImageDataBase &out ) const
+{
+    int w, h;
+    size( in, gather, w, h );
+
+    const int *shift = gather ? gather->shift : nullptr;
+
+    // Writing in place is only safe, when every pixel depends on itself alone
+    if( static_cast<const ImageDataBase *>( &out ) == &in && ( shift || w != in.w() || h != in.h() ) )
+    {
+        ImageData temporary;
+        segment( in, gather, begin, end, temporary );
+        temporary.copy( out );
+        return;
+    }
+
+    if( out.w() != w || out.h() != h )
+        out.reset( w, h );
+
+    int size = Max( tileSize, 1 );
+    std::vector<Pixel> tile( size * size );
+
+    for( int i0 = 0; i0 < h; i0 += size )
+    {
+        int i1 = Min( i0 + size, h );
+        for( int j0 = 0; j0 < w; j0 += size )
+        {
+            int j1 = Min( j0 + size, w );
+
+            auto p = tile.data();
+            for( int i = i0; i < i1; ++i )
+            {
+                for( int j = j0; j < j1; ++j )
+                    *p++ = gathered( in, shift, j, i );
+            }
+
+            apply( begin, end, w, h, j0, j1, i0, i1, tile.data() );
+
+            p = tile.data();
+            for( int i = i0; i < i1; ++i )
+            {
+                for( int j = j0; j < j1; ++j )
+                    *out( j, i ) = *p++;
+            }
+        }
+    }
+}
+
+void Pipeline::evaluate( ImageDataBase &out ) const
+{
+    ImageData buffers[2];
+    size_t next = 0;
+
+    const ImageDataBase *current = &source;
+    const Node *gather = nullptr;
+
+    auto first = nodes.data();
+    auto last = first + nodes.size();
+
+    auto materialize = [&]( const Node *finish )
+    {
+        if( !gather && first == finish )
+            return;
+
+        auto &buffer = buffers[next];
+        next = 1 - next;
+
+        segment( *current, gather, first, finish, buffer );
+        current = &buffer;
+        gather = nullptr;
+    };
+
+    for( auto node = first; node != last; ++node )
+    {
+        if( node->type == Node::Type::shift )
+        {
+            materialize( node );
+            gather = node;
+            first = node + 1;
+        }
+        else if( node->type == Node::Type::convolution )
+        {
+            // Convolution streams its input band by band, so the pending segment is evaluated row by row
+            // as the convolution asks for rows, instead of being materialized
+            auto &buffer = buffers[next];
+            next = 1 - next;
+
+            auto in = current;
+            auto shift = gather ? gather->shift : nullptr;
+            int w, h;
+            size( *in, gather, w, h );
+
+            Filters::convolution( node->params, w, h, [&]( int i, Pixel * row )
+            {
+                for( int j = 0; j < w; ++j )
+                    row[j] = gathered( *in, shift, j, i );
+                apply( first, node, w, h, 0, w, i, i + 1, row );
+            }, buffer );
+
+            current = &buffer;
+            gather = nullptr;
+            first = node + 1;
+        }
+    }
+
+    segment( *current, gather, first, last, out );
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "ImageDataBase.h"
+#include "Filters.h"
+
+// Deferred chain of image operations
+// Consecutive point-wise operations are fused and evaluated tile by tile,
+// operations that need neighbours or the whole image split the chain into segments
+class Pipeline
+{
+public:
+    using PixelFunction = std::function<void( int, int, int, int, const Pixel &, Pixel & )>;
+    using ColorFunction = std::function<void( double, double, const Color &, Color & )>;
+
+    int tileSize;
+
+    Pipeline( const ImageDataBase &source );
+
+    Pipeline &function( const PixelFunction &f );
+    Pipeline &function( const ColorFunction &f );
+    Pipeline &invert();
+    Pipeline &shiftRGB( int rx, int ry, int gx, int gy, int bx, int by );
+    Pipeline &convolution( const Filters::Convolution &params );
+
+    size_t size() const;
+    void clear();
+
+    void evaluate( ImageDataBase &out ) const;
+private:
+    struct Node
+    {
+        enum class Type
+        {
+            pixel,
+            color,
+            invert,
+            shift,
+            convolution
+        };
+
+        Type type;
+        PixelFunction pixel;
+        ColorFunction color;
+        int shift[6];
+        Filters::Convolution params;
+
+        Node( Type t );
+    };
+
+    const ImageDataBase &source;
+    std::vector<Node> nodes;
+
+    // Size of a segment, which gathers shifted channels of in
+    static void size( const ImageDataBase &in, const Node *gather, int &w, int &h );
+    // Point-wise nodes applied to a rectangle of pixels in a segment of size w x h
+    static void apply( const Node *begin, const Node *end, int w, int h, int j0, int j1, int i0, int i1, Pixel *tile );
+    void segment( const ImageDataBase &in, const Node *gather, const Node *begin, const Node *end, ImageDataBase &out ) const;
+};
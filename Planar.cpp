@@ -0,0 +1,112 @@
+#include "Planar.h"
+
+#include <cstring>
+
+#include "Exception.h"
+#include "Basic.h"
+
+Planar::Planar() : width( 0 ), height( 0 ), stride( 0 )
+{}
+
+Planar::Planar( int w, int h ) : Planar()
+{
+    reset( w, h );
+}
+
+void Planar::reset( int w, int h )
+{
+    makeException( w >= 0 && h >= 0 );
+
+    int s = ( w + alignment - 1 ) / alignment * alignment;
+    size_t size = ( size_t )s * h * 4;
+    if( size != ( size_t )stride * height * 4 )
+        data.reset( size ? ( unsigned char * )::operator new( size, std::align_val_t( alignment ) ) : nullptr );
+
+    width = w;
+    height = h;
+    stride = s;
+}
+
+int Planar::w() const
+{
+    return width;
+}
+
+int Planar::h() const
+{
+    return height;
+}
+
+int Planar::s() const
+{
+    return stride;
+}
+
+unsigned char *Planar::operator()( Channel c, int i )
+{
+    return data.get() + ( ( size_t )c * height + i ) * stride;
+}
+
+const unsigned char *Planar::operator()( Channel c, int i ) const
+{
+    return data.get() + ( ( size_t )c * height + i ) * stride;
+}
+
+void Planar::fill( Channel c, unsigned char value )
+{
+    if( height )
+        std::memset( ( *this )( c, 0 ), value, ( size_t )stride * height );
+}
+
+void Planar::deinterleave( const ImageDataBase &image )
+{
+    reset( image.w(), image.h() );
+
+    Parallel::rows( height, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = image( 0, i );
+            auto b = ( *this )( Channel::b, i ), g = ( *this )( Channel::g, i );
+            auto r = ( *this )( Channel::r, i ), a = ( *this )( Channel::a, i );
+            for( int j = 0; j < width; ++j )
+            {
+                b[j] = p[j].b;
+                g[j] = p[j].g;
+                r[j] = p[j].r;
+                a[j] = p[j].a;
+            }
+        }
+    } );
+}
+
+void Planar::interleave( ImageDataBase &image ) const
+{
+    if( image.w() != width || image.h() != height )
+        image.reset( width, height );
+
+    Parallel::rows( height, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = image( 0, i );
+            auto b = ( *this )( Channel::b, i ), g = ( *this )( Channel::g, i );
+            auto r = ( *this )( Channel::r, i ), a = ( *this )( Channel::a, i );
+            for( int j = 0; j < width; ++j )
+                p[j] = Pixel( r[j], g[j], b[j], a[j] );
+        }
+    } );
+}
+
+void Planar::place( Channel c, const Planar &source, int x, int y )
+{
+    makeException( &source != this );
+
+    int j0 = Max( x, 0 ), j1 = Min( x + source.w(), width );
+    int i0 = Max( y, 0 ), i1 = Min( y + source.h(), height );
+    if( j0 >= j1 || i0 >= i1 )
+        return;
+
+    for( int i = i0; i < i1; ++i )
+        std::memcpy( ( *this )( c, i ) + j0, source( c, i - y ) + j0 - x, j1 - j0 );
+}
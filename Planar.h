@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <new>
+
+#include "ImageDataBase.h"
+
+// Image with every channel in a separate plane, for algorithms that process channels independently
+// Rows of every plane start at 64 byte boundaries, so they can be read with unit stride vector loads
+class Planar
+{
+public:
+    // Same order as in Pixel
+    enum class Channel
+    {
+        b,
+        g,
+        r,
+        a
+    };
+
+    static constexpr int alignment = 64;
+
+    Planar();
+    Planar( int w, int h );
+
+    void reset( int w, int h );
+
+    int w() const;
+    int h() const;
+    // Bytes between rows of a plane, multiple of alignment
+    int s() const;
+
+    unsigned char *operator()( Channel c, int i );
+    const unsigned char *operator()( Channel c, int i ) const;
+
+    void fill( Channel c, unsigned char value );
+
+    void deinterleave( const ImageDataBase &image );
+    void interleave( ImageDataBase &image ) const;
+
+    // Plane c of source is placed at x, y of plane c, parts outside are clipped
+    void place( Channel c, const Planar &source, int x, int y );
+private:
+    struct Free
+    {
+        void operator()( unsigned char *p ) const
+        {
+            ::operator delete( p, std::align_val_t( alignment ) );
+        }
+    };
+
+    int width, height, stride;
+    std::unique_ptr<unsigned char, Free> data;
+};
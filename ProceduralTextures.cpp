@@ -11,17 +11,22 @@
 #include "Matrix.h"
 
 #include "ImageData.h"
-#include "GetImage.h"
+#include "Parallel.h"
+#include "Resample.h"
 #include "Text.h"
 
 RandomFunction::RandomFunction( RandomNumber& random, size_t intervalCount, size_t coefficientsCount, double min, double max )
+    : RandomFunction( RandomStream( random ), intervalCount, coefficientsCount, min, max )
+{}
+
+RandomFunction::RandomFunction( const RandomStream& random, size_t intervalCount, size_t coefficientsCount, double min, double max )
 {
     if( intervalCount < 1 )
         return;
 
     std::vector<double> results( intervalCount );
     for( size_t n = 0; n < intervalCount; ++n )
-        results[n] = random.getReal( min, max );
+        results[n] = random.split( n ).getReal( min, max );
 
     auto aF = []( size_t n, double x )
     {
@@ -334,6 +339,68 @@ void Arch::trimBy( const Sphere& other )
     {}
 }
 
+SphereGrid::SphereGrid( const std::vector<Sphere>& s, double r, size_t count ) : spheres( s ), maxRadius( r )
+{
+    // About one sphere per cell, but cells not smaller than a sphere
+    n = Max( Min( ( int )( 1 / maxRadius ), ( int )Sqrt( ( double )count ) ), 1 );
+    cells.resize( n * n );
+}
+
+int SphereGrid::index( double coordinate ) const
+{
+    int k = ( int )( RoundDown( ( coordinate + 0.5 ) * n ) % n );
+    return k < 0 ? k + n : k;
+}
+
+void SphereGrid::add( size_t id )
+{
+    auto p = spheres[id].position();
+    cells[index( p.y ) * n + index( p.x )].push_back( id );
+}
+
+void SphereGrid::near( const Vector2D& point, double distance, std::vector<size_t>& result ) const
+{
+    result.clear();
+
+    auto p = Sphere::uncopy( point );
+    int range = ( int )RoundUp( ( distance + maxRadius ) * n );
+
+    auto span = [this, range]( int center, int& first, int& last )
+    {
+        if( 2 * range + 1 >= n )
+        {
+            first = 0;
+            last = n - 1;
+        }
+        else
+        {
+            first = center - range;
+            last = center + range;
+        }
+    };
+
+    int x0, x1, y0, y1;
+    span( index( p.x ), x0, x1 );
+    span( index( p.y ), y0, y1 );
+
+    for( int y = y0; y <= y1; ++y )
+    {
+        int row = ( ( y % n + n ) % n ) * n;
+        for( int x = x0; x <= x1; ++x )
+        {
+            for( auto id : cells[row + ( x % n + n ) % n] )
+            {
+                auto& sphere = spheres[id];
+                auto d = Sphere::uncopy( sphere.position() - p );
+                if( d.Abs() <= distance + sphere.radius() )
+                    result.push_back( id );
+            }
+        }
+    }
+
+    std::sort( result.begin(), result.end() );
+}
+
 void threadSegment( ImageDataBase& image, const Stripe& s, double side, double height, const Stripe& area )
 {
     auto mid = s.middle();
@@ -343,7 +410,7 @@ void threadSegment( ImageDataBase& image, const Stripe& s, double side, double h
         Affine2D( Matrix2D::Scale( 1 / side, 2 / s.width ) ) *
         Affine2D( Matrix2D::Rotation( -ArcTan2( s.dir.y, s.dir.x ) ) );
 
-    image.function( image, [&]( double x, double y, const Color & in, Color & out )
+    image.map( pure( [&]( double x, double y, const Color & in, Color & out )
     {
         Vector2D p( x, y );
 
@@ -400,7 +467,7 @@ void threadSegment( ImageDataBase& image, const Stripe& s, double side, double h
         {
             out = in;
         }
-    } );
+    } ) );
 }
 
 void ropeSegment( ImageDataBase& image, const Stripe& s, double tangent, double step )
@@ -461,19 +528,28 @@ void tissueFragment( ImageDataBase& image, const Tissue& t )
         ropeSegment( horizontal, Stripe( Vector2D( -0.5, y ), Vector2D( 0.5, y ), widthH ), t.tangent, stepH );
     };
 
-    for( int i = 0; i < t.horizontal; ++i )
-    {
-        // if( i % 2 == 1 )
-        crossH( ( i + 0.5 ) * widthH - 0.5 );
-    }
-
-    for( int j = 0; j < t.vertical; ++j )
+    // Ropes of one layer overlap each other, layers only meet in the final composition
+    Parallel::tasks( 2, [&]( size_t layer )
     {
-        // if( j % 2 == 1 )
-        crossV( ( j + 0.5 ) * widthV - 0.5 );
-    }
+        if( layer == 0 )
+        {
+            for( int i = 0; i < t.horizontal; ++i )
+            {
+                // if( i % 2 == 1 )
+                crossH( ( i + 0.5 ) * widthH - 0.5 );
+            }
+        }
+        else
+        {
+            for( int j = 0; j < t.vertical; ++j )
+            {
+                // if( j % 2 == 1 )
+                crossV( ( j + 0.5 ) * widthV - 0.5 );
+            }
+        }
+    } );
 
-    image.function( image, [&]( int w, int h, int j, int i, const Pixel &, Pixel & out )
+    image.map( pure( [&]( int w, int h, int j, int i, const Pixel &, Pixel & out )
     {
         auto option0 = vertical( j, i );
         auto option1 = horizontal( j, i );
@@ -493,22 +569,17 @@ void tissueFragment( ImageDataBase& image, const Tissue& t )
         {
             out = Pixel( 0, 0, 0, 0 );
         }
-    } );
+    } ) );
 
     ImageData scaled;
-    scaled.reset( t.granule, t.granule );
-
-    ImageConvert::Reference in, sc;
-    makeReference( image, in );
-    makeReference( scaled, sc );
-    translate( in, sc, true );
+    Resample::resize( image, scaled, t.granule, t.granule, Resample::Filter::box );
 
     image.reset( t.width, t.height );
-    image.function( image, [&]( int, int, int j, int i, const Pixel &, Pixel & out )
+    image.map( pure( [&]( int, int, int j, int i, const Pixel &, Pixel & out )
     {
         out = *scaled( j % scaled.w(), i % scaled.h() );
         out.a = 255;
-    } );
+    } ) );
 }
 
 void cell( MatrixBase<double>& map, std::deque<Vector2D> shape, const std::vector<Vector2D>& positions )
@@ -523,8 +594,28 @@ void cell( MatrixBase<double>& map, std::deque<Vector2D> shape, const std::vecto
     if( s < 0 )
         std::reverse( shape.begin(), shape.end() );
 
+    Vector2D low = shape[0], high = shape[0];
+    for( auto& point : shape )
+    {
+        low.x = Min( low.x, point.x );
+        low.y = Min( low.y, point.y );
+        high.x = Max( high.x, point.x );
+        high.y = Max( high.y, point.y );
+    }
+
+    int w = map.w(), h = map.h();
+
     for( auto& shift : positions )
     {
+        // Only pixels with centres inside the shifted bounding box can belong to the cell
+        int j0 = Max<int>( RoundUp( ( low.x + shift.x + 0.5 ) * w - 0.5 ), 0 );
+        int j1 = Min<int>( RoundDown( ( high.x + shift.x + 0.5 ) * w - 0.5 ), w - 1 );
+        int i0 = Max<int>( RoundUp( ( low.y + shift.y + 0.5 ) * h - 0.5 ), 0 );
+        int i1 = Min<int>( RoundDown( ( high.y + shift.y + 0.5 ) * h - 0.5 ), h - 1 );
+
+        if( j0 > j1 || i0 > i1 )
+            continue;
+
         auto function = [&]( double x, double y ) -> std::optional<double>
         {
             double distance = std::numeric_limits<double>::max();
@@ -547,29 +638,48 @@ void cell( MatrixBase<double>& map, std::deque<Vector2D> shape, const std::vecto
             return distance;
         };
 
-        map.transform<double>( map, [&]( int w, int h, int j, int i, const double & in, double & out )
+        Parallel::rows( i1 - i0 + 1, [&]( int begin, int end )
         {
-            auto d = function( ( j + 0.5 ) / w - 0.5, ( i + 0.5 ) / h - 0.5 );
-            out = d ? *d : in;
+            for( int i = i0 + begin; i < i0 + end; ++i )
+            {
+                for( int j = j0; j <= j1; ++j )
+                {
+                    if( auto d = function( ( j + 0.5 ) / w - 0.5, ( i + 0.5 ) / h - 0.5 ) )
+                        *map( j, i ) = *d;
+                }
+            }
         } );
     }
 }
 
 void cellStructure( ImageDataBase& image, RandomNumber& random, int size, double minRadius, double maxRadius, size_t cellCount )
+{
+    cellStructure( image, RandomStream( random ), size, minRadius, maxRadius, cellCount );
+}
+
+void cellStructure( ImageDataBase& image, const RandomStream& random, int size, double minRadius, double maxRadius, size_t cellCount )
 {
     makeException( minRadius > 0 && maxRadius > 0 && maxRadius >= minRadius && maxRadius <= 0.25 );
 
     std::vector<Sphere> spheres;
+    SphereGrid grid( spheres, maxRadius, cellCount );
+    std::vector<size_t> near;
     size_t count = 0;
+    uint64_t attempt = 0;
 
     while( count < cellCount )
     {
-        Sphere s( Vector2D( random.getReal( -0.5, 0.5 ), random.getReal( -0.5, 0.5 ) ), random.getReal( minRadius, maxRadius ) );
+        auto candidate = random.split( attempt++ );
+        auto x = candidate.getReal( -0.5, 0.5 );
+        auto y = candidate.getReal( -0.5, 0.5 );
+        auto r = candidate.getReal( minRadius, maxRadius );
+        Sphere s( Vector2D( x, y ), r );
 
         bool inside = false;
-        for( const auto& sphere : spheres )
+        grid.near( s.position(), 0, near );
+        for( auto k : near )
         {
-            if( s.inside( sphere ) )
+            if( s.inside( spheres[k] ) )
             {
                 inside = true;
                 break;
@@ -579,24 +689,31 @@ void cellStructure( ImageDataBase& image, RandomNumber& random, int size, double
         if( !inside )
         {
             spheres.push_back( s );
-            ++count;
+            grid.add( count++ );
         }
     }
 
     std::vector<std::vector<size_t>> polygons( count );
     std::vector<Arch> arches;
 
+    // Spheres and arches only interact with spheres, that they overlap
+    std::vector<size_t> trimmers;
     for( size_t i = 0; i < count; ++i )
     {
-        for( size_t j = i + 1; j < count; ++j )
+        grid.near( spheres[i].position(), spheres[i].radius(), near );
+        for( auto j : near )
         {
+            if( j <= i )
+                continue;
+
             auto arch = spheres[i].intersect( spheres[j] );
             if( arch )
             {
                 polygons[i].push_back( arches.size() );
                 polygons[j].push_back( arches.size() );
 
-                for( size_t k = 0; k < count; ++k )
+                grid.near( arch->position( 0 ), arch->radius(), trimmers );
+                for( auto k : trimmers )
                 {
                     if( k != i && k != j )
                         arch->trimBy( spheres[k] );
@@ -606,13 +723,14 @@ void cellStructure( ImageDataBase& image, RandomNumber& random, int size, double
         }
     }
 
-    auto function = [&spheres]( double x, double y )
+    auto function = [&spheres, &grid]( double x, double y, std::vector<size_t>& candidates )
     {
         double z = 0;
         Vector2D p( x, y );
-        for( auto& s : spheres )
+        grid.near( p, 0, candidates );
+        for( auto k : candidates )
         {
-            auto h = s.height( p );
+            auto h = spheres[k].height( p );
             if( h > z )
                 z = h;
         }
@@ -623,14 +741,20 @@ void cellStructure( ImageDataBase& image, RandomNumber& random, int size, double
 
     MatrixBase<double> matrix( size, size );
 
-    for( int j = 0; j < size; ++j )
+    Parallel::rows( size, [&]( int begin, int end )
     {
-        for( int i = 0; i < size; ++i )
+        std::vector<size_t> candidates;
+        for( int i = begin; i < end; ++i )
         {
-            auto height = function( ( j + 0.5 ) / size - 0.5, ( i + 0.5 ) / size - 0.5 );
-            *matrix( j, i ) = height;
-            heights.add( height );
+            for( int j = 0; j < size; ++j )
+                *matrix( j, i ) = function( ( j + 0.5 ) / size - 0.5, ( i + 0.5 ) / size - 0.5, candidates );
         }
+    } );
+
+    for( int j = 0; j < size; ++j )
+    {
+        for( int i = 0; i < size; ++i )
+            heights.add( *matrix( j, i ) );
     }
 
     matrix.transform<Pixel>( image, [&]( int, int, int, int, const double & in, Pixel & out )
@@ -808,15 +932,21 @@ void cellStructure( ImageDataBase& image, RandomNumber& random, int size, double
 }
 
 void woodSlice( ImageDataBase& image, RandomNumber& random, const Trunk& t )
+{
+    woodSlice( image, RandomStream( random ), t );
+}
+
+void woodSlice( ImageDataBase& image, const RandomStream& random, const Trunk& t )
 {
     std::vector<double> layerWidth;
     layerWidth.resize( t.layerCount );
 
     {
+        auto layers = random.split( 0 );
         double r = 0.0;
         for( auto& l : layerWidth )
         {
-            l = random.getReal( 1.0, 1.0 + t.variation );
+            l = layers.getReal( 1.0, 1.0 + t.variation );
             r += l;
         }
 
@@ -844,7 +974,7 @@ void woodSlice( ImageDataBase& image, RandomNumber& random, const Trunk& t )
         ++i;
     }
 
-    RandomFunction f( random, 64, 16, 0, 1 );
+    RandomFunction f( random.split( 1 ), 64, 16, 0, 1 );
 
     auto function = [&]( double x, double y )
     {
@@ -864,7 +994,7 @@ void woodSlice( ImageDataBase& image, RandomNumber& random, const Trunk& t )
 
     auto maximalBumpRatio = 1 / t.maximalDentRatio - 1;
 
-    image.function( image, [&]( double x, double y, const Color &, Color & out )
+    image.map( pure( [&]( double x, double y, const Color &, Color & out )
     {
         auto r = ( deformation.normalize( function( x, y ) ) * maximalBumpRatio + 1 ) * Pow( 4 * ( x * x + y * y ), t.power );
         if( r >= 1 )
@@ -899,10 +1029,15 @@ void woodSlice( ImageDataBase& image, RandomNumber& random, const Trunk& t )
         }
 
         out = inner ? t.innerInside * ( 1 - p ) + t.innerOutside * p : t.outerInside * ( 1 - p ) + t.outerOutside * p;
-    } );
+    } ) );
 }
 
 void watermelonPeel( ImageDataBase& image, RandomNumber& random )
+{
+    watermelonPeel( image, RandomStream( random ) );
+}
+
+void watermelonPeel( ImageDataBase& image, const RandomStream& random )
 {
     auto getSize = []( double x )
     {
@@ -926,29 +1061,41 @@ void watermelonPeel( ImageDataBase& image, RandomNumber& random )
 
     for( int i = 0; i < 1024 * 50; ++i )
     {
-        int x = random.getInteger( 0, w );
-        int y = random.getInteger( 0, h );
+        auto spot = random.split( i );
+        int x = spot.getInteger( 0, w );
+        int y = spot.getInteger( 0, h );
         int size = Round( getSize( x ) );
         image.circle( x, y, size, {}, Pixel( 0, 128, 0 ) );
     }
 }
 
 void watermelonPulp( ImageDataBase& image, RandomNumber& random )
+{
+    watermelonPulp( image, RandomStream( random ) );
+}
+
+void watermelonPulp( ImageDataBase& image, const RandomStream& random )
 {
     int w = 1024, h = 1024;
     image.reset( w, h, Pixel( 255, 0, 0 ) );
 
     for( int i = 0; i < 256; ++i )
     {
-        int x = random.getInteger( 0, w );
-        int y = random.getInteger( 0, h );
-        int size = random.getInteger( 5, 9 );
+        auto seed = random.split( i );
+        int x = seed.getInteger( 0, w );
+        int y = seed.getInteger( 0, h );
+        int size = seed.getInteger( 5, 9 );
         int d = 6 * ( 9 - size );
         image.circle( x, y, size, {}, Pixel( 40 + 3 * d / 2, 40 - d, 40 - d ) );
     }
 }
 
 void randomImage( ImageDataBase& image, RandomNumber& random, int width, int height, int m, int n, int granulePower, double decayCoefficient )
+{
+    randomImage( image, RandomStream( random ), width, height, m, n, granulePower, decayCoefficient );
+}
+
+void randomImage( ImageDataBase& image, const RandomStream& random, int width, int height, int m, int n, int granulePower, double decayCoefficient )
 {
     std::vector<double> coefficients;
     coefficients.resize( granulePower );
@@ -963,7 +1110,7 @@ void randomImage( ImageDataBase& image, RandomNumber& random, int width, int hei
         maxGranule *= 2;
     }
 
-    auto createGranule = [&]( ImageData & g )
+    auto createGranule = [&]( ImageData & g, RandomStream granuleRandom )
     {
         std::vector<MatrixBase<double>> matrices;
 
@@ -976,7 +1123,7 @@ void randomImage( ImageDataBase& image, RandomNumber& random, int width, int hei
                 for( int i = 0; i < granule; ++i )
                 {
                     // *matrix( j, i ) = random.getReal( 0.0, 1.0 );
-                    *matrix( j, i ) = random.getInteger( 0, 1 );
+                    *matrix( j, i ) = granuleRandom.getInteger( 0, 1 );
                 }
             }
             granule *= 2;
@@ -997,20 +1144,16 @@ void randomImage( ImageDataBase& image, RandomNumber& random, int width, int hei
         } );
     };
 
-    ImageData canvas( m * maxGranule, n * maxGranule ), granule( maxGranule, maxGranule );
-    for( int j = 0; j < m; ++j )
+    // Every granule has its own stream and its own area of the canvas
+    ImageData canvas( m * maxGranule, n * maxGranule );
+    Parallel::tasks( Max( m, 0 ) * Max( n, 0 ), [&]( size_t k )
     {
-        for( int i = 0; i < n; ++i )
-        {
-            createGranule( granule );
-            granule.place( canvas, j * maxGranule, i * maxGranule );
-        }
-    }
+        int j = ( int )k / n, i = ( int )k % n;
 
-    image.reset( width, height );
+        ImageData granule( maxGranule, maxGranule );
+        createGranule( granule, random.lattice( j, i ) );
+        granule.place( canvas, j * maxGranule, i * maxGranule );
+    } );
 
-    ImageConvert::Reference in, sc;
-    makeReference( canvas, in );
-    makeReference( image, sc );
-    translate( in, sc, true );
+    Resample::resize( canvas, image, width, height, Resample::Filter::bicubic );
 }
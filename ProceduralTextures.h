@@ -3,6 +3,7 @@
 #include <string>
 #include <deque>
 
+#include "RandomStream.h"
 #include "RandomNumber.h"
 #include "Matrix2D.h"
 #include "Vector2D.h"
@@ -16,6 +17,7 @@ struct RandomFunction
     std::vector<std::array<double, 2>> coefficients;
 
     RandomFunction( RandomNumber& random, size_t intervalCount, size_t coefficientsCount, double min, double max );
+    RandomFunction( const RandomStream& random, size_t intervalCount, size_t coefficientsCount, double min, double max );
 
     double operator()( double x ) const;
 };
@@ -100,17 +102,42 @@ public:
     void trimBy( const Sphere& s );
 };
 
+// Uniform grid over sphere centres on the unit torus [-0.5, 0.5)²
+class SphereGrid
+{
+private:
+    const std::vector<Sphere>& spheres;
+    std::vector<std::vector<size_t>> cells;
+    double maxRadius;
+    int n;
+
+    int index( double coordinate ) const;
+
+public:
+    SphereGrid( const std::vector<Sphere>& s, double r, size_t count );
+
+    void add( size_t id );
+
+    // Indices of spheres closer to the point than distance plus their radius, in ascending order
+    void near( const Vector2D& point, double distance, std::vector<size_t>& result ) const;
+};
+
 void threadSegment( ImageDataBase& image, const Stripe& s, double side, double height, const Stripe& area );
 void ropeSegment( ImageDataBase& image, const Stripe& s, double tangent, double step );
 
 void cell( MatrixBase<double>& map, std::deque<Vector2D> shape, const std::vector<Vector2D>& positions );
 void cellStructure( ImageDataBase& image, RandomNumber& random, int size, double minRadius, double maxRadius, size_t cellCount );
+void cellStructure( ImageDataBase& image, const RandomStream& random, int size, double minRadius, double maxRadius, size_t cellCount );
 
 void tissueFragment( ImageDataBase& image, const Tissue& t );
 
 void woodSlice( ImageDataBase& image, RandomNumber& random, const Trunk& t );
+void woodSlice( ImageDataBase& image, const RandomStream& random, const Trunk& t );
 
 void watermelonPeel( ImageDataBase& image, RandomNumber& random );
+void watermelonPeel( ImageDataBase& image, const RandomStream& random );
 void watermelonPulp( ImageDataBase& image, RandomNumber& random );
+void watermelonPulp( ImageDataBase& image, const RandomStream& random );
 
 void randomImage( ImageDataBase& image, RandomNumber& random, int width, int height, int m, int n, int granulePower, double decayCoefficient );
+void randomImage( ImageDataBase& image, const RandomStream& random, int width, int height, int m, int n, int granulePower, double decayCoefficient );
@@ -0,0 +1,321 @@
+#include "Quantization.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Exception.h"
+#include "Basic.h"
+
+namespace Quantization
+{
+static int distance( const Pixel &p0, const Pixel &p1 )
+{
+    return Sqr( ( int )p0.r - ( int )p1.r ) + Sqr( ( int )p0.g - ( int )p1.g ) + Sqr( ( int )p0.b - ( int )p1.b );
+}
+
+static size_t nearest( const std::vector<Pixel> &colors, const Pixel &p )
+{
+    size_t best = 0;
+    int bestDistance = std::numeric_limits<int>::max();
+    for( size_t k = 0; k < colors.size(); ++k )
+    {
+        auto d = distance( colors[k], p );
+        if( d < bestDistance )
+        {
+            bestDistance = d;
+            best = k;
+        }
+    }
+    return best;
+}
+
+Histogram::Histogram() : bins( size, Bin{ 0, 0, 0, 0 } )
+{}
+
+int Histogram::index( const Pixel &p )
+{
+    return ( ( p.r >> ( 8 - bits ) ) << ( 2 * bits ) ) | ( ( p.g >> ( 8 - bits ) ) << bits ) | ( p.b >> ( 8 - bits ) );
+}
+
+void Histogram::add( const ImageDataBase &image )
+{
+    int w = image.w(), h = image.h();
+    for( int i = 0; i < h; ++i )
+    {
+        auto p = image( 0, i );
+        for( int j = 0; j < w; ++j, ++p )
+        {
+            auto &bin = bins[index( *p )];
+            ++bin.count;
+            bin.r += p->r;
+            bin.g += p->g;
+            bin.b += p->b;
+        }
+    }
+}
+
+Pixel Histogram::mean( int k ) const
+{
+    auto &bin = bins[k];
+    if( bin.count == 0 )
+        return Pixel();
+
+    auto half = bin.count / 2;
+    return Pixel( ( bin.r + half ) / bin.count, ( bin.g + half ) / bin.count, ( bin.b + half ) / bin.count );
+}
+
+std::vector<Pixel> palette( const Histogram &histogram, size_t count, int iterations )
+{
+    std::vector<int> cells;
+    for( int k = 0; k < Histogram::size; ++k )
+    {
+        if( histogram.bins[k].count > 0 )
+            cells.push_back( k );
+    }
+
+    if( cells.empty() || count == 0 )
+        return {};
+
+    // Channel 0 is blue, 1 is green, 2 is red
+    auto channel = []( int k, int c )
+    {
+        return ( k >> ( c * Histogram::bits ) ) & ( Histogram::side - 1 );
+    };
+
+    struct Box
+    {
+        size_t begin, end;
+        uint64_t count;
+        int low[3], high[3];
+    };
+
+    auto shrink = [&]( Box & box )
+    {
+        box.count = 0;
+        for( int c = 0; c < 3; ++c )
+        {
+            box.low[c] = Histogram::side;
+            box.high[c] = -1;
+        }
+
+        for( auto k = box.begin; k < box.end; ++k )
+        {
+            box.count += histogram.bins[cells[k]].count;
+            for( int c = 0; c < 3; ++c )
+            {
+                auto v = channel( cells[k], c );
+                box.low[c] = Min( box.low[c], v );
+                box.high[c] = Max( box.high[c], v );
+            }
+        }
+    };
+
+    std::vector<Box> boxes( 1 );
+    boxes[0].begin = 0;
+    boxes[0].end = cells.size();
+    shrink( boxes[0] );
+
+    while( boxes.size() < count )
+    {
+        // Split the box with the most pixels spread along the longest side
+        size_t best = boxes.size();
+        int bestChannel = 0;
+        uint64_t bestScore = 0;
+        for( size_t n = 0; n < boxes.size(); ++n )
+        {
+            auto &box = boxes[n];
+            if( box.end - box.begin < 2 )
+                continue;
+
+            int c = 0;
+            for( int d = 1; d < 3; ++d )
+            {
+                if( box.high[d] - box.low[d] > box.high[c] - box.low[c] )
+                    c = d;
+            }
+
+            auto score = box.count * ( box.high[c] - box.low[c] + 1 );
+            if( score > bestScore )
+            {
+                bestScore = score;
+                best = n;
+                bestChannel = c;
+            }
+        }
+
+        if( best == boxes.size() )
+            break;
+
+        auto &box = boxes[best];
+        std::sort( cells.begin() + box.begin, cells.begin() + box.end, [&]( int k0, int k1 )
+        {
+            return channel( k0, bestChannel ) < channel( k1, bestChannel );
+        } );
+
+        auto half = box.count / 2;
+        uint64_t sum = 0;
+        auto middle = box.begin;
+        while( middle + 1 < box.end && sum + histogram.bins[cells[middle]].count <= half )
+            sum += histogram.bins[cells[middle++]].count;
+        middle = Max( middle, box.begin + 1 );
+
+        Box second;
+        second.begin = middle;
+        second.end = box.end;
+        box.end = middle;
+
+        shrink( box );
+        shrink( second );
+        boxes.push_back( second );
+    }
+
+    std::vector<Pixel> colors;
+    for( auto &box : boxes )
+    {
+        uint64_t r = 0, g = 0, b = 0;
+        for( auto k = box.begin; k < box.end; ++k )
+        {
+            auto &bin = histogram.bins[cells[k]];
+            r += bin.r;
+            g += bin.g;
+            b += bin.b;
+        }
+        colors.emplace_back( r / box.count, g / box.count, b / box.count );
+    }
+
+    // Bins are weighted by their pixel count, so each step is exact k-means over the reduced colors
+    std::vector<Histogram::Bin> sums( colors.size() );
+    std::vector<size_t> assignment( cells.size() );
+    for( int iteration = 0; iteration < iterations; ++iteration )
+    {
+        Parallel::rows( cells.size(), [&]( int begin, int end )
+        {
+            for( int n = begin; n < end; ++n )
+                assignment[n] = nearest( colors, histogram.mean( cells[n] ) );
+        } );
+
+        std::fill( sums.begin(), sums.end(), Histogram::Bin{ 0, 0, 0, 0 } );
+        for( size_t n = 0; n < cells.size(); ++n )
+        {
+            auto &bin = histogram.bins[cells[n]];
+            auto &sum = sums[assignment[n]];
+            sum.count += bin.count;
+            sum.r += bin.r;
+            sum.g += bin.g;
+            sum.b += bin.b;
+        }
+
+        for( size_t n = 0; n < colors.size(); ++n )
+        {
+            auto &sum = sums[n];
+            if( sum.count > 0 )
+                colors[n] = Pixel( sum.r / sum.count, sum.g / sum.count, sum.b / sum.count );
+        }
+    }
+
+    return colors;
+}
+
+LookUp::LookUp( const std::vector<Pixel> &palette ) : colors( palette ), table( Histogram::size )
+{
+    makeException( !colors.empty() && colors.size() <= std::numeric_limits<uint16_t>::max() + size_t( 1 ) );
+
+    int shift = 8 - Histogram::bits;
+    int center = 1 << ( shift - 1 );
+    Parallel::rows( Histogram::side, [&]( int begin, int end )
+    {
+        for( int r = begin; r < end; ++r )
+        {
+            for( int g = 0; g < Histogram::side; ++g )
+            {
+                for( int b = 0; b < Histogram::side; ++b )
+                {
+                    Pixel p( ( r << shift ) + center, ( g << shift ) + center, ( b << shift ) + center );
+                    table[Histogram::index( p )] = nearest( colors, p );
+                }
+            }
+        }
+    } );
+}
+
+size_t LookUp::index( const Pixel &p ) const
+{
+    return table[Histogram::index( p )];
+}
+
+const Pixel &LookUp::operator()( const Pixel &p ) const
+{
+    return colors[index( p )];
+}
+
+void apply( const ImageDataBase &in, ImageDataBase &out, const std::vector<Pixel> &palette, bool dither )
+{
+    LookUp lookUp( palette );
+
+    if( !dither )
+    {
+        in.map( out, pure( [&lookUp]( const Pixel & u, Pixel & v )
+        {
+            v = lookUp( u );
+            v.a = u.a;
+        } ) );
+        return;
+    }
+
+    int w = in.w(), h = in.h();
+    if( static_cast<const ImageDataBase *>( &out ) != &in )
+        out.reset( w, h );
+
+    // Floyd–Steinberg, errors of the current and the next row with a pixel of margin on both sides
+    std::vector<int> current( 3 * ( w + 2 ), 0 ), next( 3 * ( w + 2 ), 0 );
+
+    for( int i = 0; i < h; ++i )
+    {
+        std::fill( next.begin(), next.end(), 0 );
+
+        auto u = in( 0, i );
+        auto v = out( 0, i );
+        for( int j = 0; j < w; ++j )
+        {
+            auto e = &current[3 * ( j + 1 )];
+            int value[3] =
+            {
+                Max( Min( u[j].r + e[0] / 16, 255 ), 0 ),
+                Max( Min( u[j].g + e[1] / 16, 255 ), 0 ),
+                Max( Min( u[j].b + e[2] / 16, 255 ), 0 )
+            };
+
+            auto alpha = u[j].a;
+            auto &q = lookUp( Pixel( value[0], value[1], value[2] ) );
+            int error[3] = { value[0] - q.r, value[1] - q.g, value[2] - q.b };
+
+            v[j] = q;
+            v[j].a = alpha;
+
+            auto n = &next[3 * ( j + 1 )];
+            for( int c = 0; c < 3; ++c )
+            {
+                e[c + 3] += 7 * error[c];
+                n[c - 3] += 3 * error[c];
+                n[c] += 5 * error[c];
+                n[c + 3] += error[c];
+            }
+        }
+
+        std::swap( current, next );
+    }
+}
+
+bool quantize( const ImageDataBase &in, ImageDataBase &out, size_t count, bool dither )
+{
+    Histogram histogram;
+    histogram.add( in );
+
+    auto colors = palette( histogram, count );
+    if( colors.empty() )
+        return false;
+
+    apply( in, out, colors, dither );
+    return true;
+}
+}
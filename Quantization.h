@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ImageDataBase.h"
+
+namespace Quantization
+{
+// Pixel counts with 5 bits per color channel, alpha is ignored
+class Histogram
+{
+public:
+    static constexpr int bits = 5;
+    static constexpr int side = 1 << bits;
+    static constexpr int size = side * side * side;
+
+    struct Bin
+    {
+        uint64_t count, r, g, b;
+    };
+
+    std::vector<Bin> bins;
+
+    Histogram();
+
+    static int index( const Pixel &p );
+
+    void add( const ImageDataBase &image );
+    Pixel mean( int k ) const;
+};
+
+// At most count colors, median cut of the histogram refined by k-means iterations
+std::vector<Pixel> palette( const Histogram &histogram, size_t count, int iterations = 4 );
+
+// Nearest palette color for every histogram bin
+class LookUp
+{
+private:
+    std::vector<Pixel> colors;
+    std::vector<uint16_t> table;
+public:
+    LookUp( const std::vector<Pixel> &palette );
+
+    size_t index( const Pixel &p ) const;
+    const Pixel &operator()( const Pixel &p ) const;
+};
+
+// Replaces colors by their nearest palette colors, alpha is kept
+void apply( const ImageDataBase &in, ImageDataBase &out, const std::vector<Pixel> &palette, bool dither = false );
+
+bool quantize( const ImageDataBase &in, ImageDataBase &out, size_t count, bool dither = false );
+}
@@ -0,0 +1,122 @@
+#include "RandomStream.h"
+
+#include <cstring>
+
+static void multiply( uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo )
+{
+    uint64_t product = ( uint64_t )a * b;
+    hi = ( uint32_t )( product >> 32 );
+    lo = ( uint32_t )product;
+}
+
+void RandomStream::philox( uint32_t c[4], const uint32_t k[2] )
+{
+    uint32_t k0 = k[0], k1 = k[1];
+    uint32_t hi0, lo0, hi1, lo1;
+
+    for( int round = 0; round < 10; ++round )
+    {
+        if( round > 0 )
+        {
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+
+        multiply( 0xD2511F53, c[0], hi0, lo0 );
+        multiply( 0xCD9E8D57, c[2], hi1, lo1 );
+
+        c[0] = hi1 ^ c[1] ^ k0;
+        c[1] = lo1;
+        c[2] = hi0 ^ c[3] ^ k1;
+        c[3] = lo0;
+    }
+}
+
+RandomStream::RandomStream( uint64_t seed ) : stream( 0 ), counter( 0 ), used( 4 )
+{
+    key[0] = ( uint32_t )seed;
+    key[1] = ( uint32_t )( seed >> 32 );
+}
+
+// Halves are drawn in separate statements, so the key does not depend on the order of evaluation chosen by the compiler
+static uint64_t drawSeed( RandomNumber &random )
+{
+    uint64_t high = ( uint64_t )random.getInteger( 0, 0xFFFFFFFF );
+    uint64_t low = ( uint64_t )random.getInteger( 0, 0xFFFFFFFF );
+    return ( high << 32 ) | low;
+}
+
+RandomStream::RandomStream( RandomNumber &random ) : RandomStream( drawSeed( random ) )
+{}
+
+void RandomStream::refill()
+{
+    block[0] = ( uint32_t )counter;
+    block[1] = ( uint32_t )( counter >> 32 );
+    block[2] = ( uint32_t )stream;
+    block[3] = ( uint32_t )( stream >> 32 );
+    philox( block, key );
+    ++counter;
+    used = 0;
+}
+
+std::array<uint64_t, 4> RandomStream::state() const
+{
+    return { ( ( uint64_t )key[1] << 32 ) | key[0], stream, counter, used };
+}
+
+RandomStream RandomStream::split( uint64_t id ) const
+{
+    // Stream ids are derived with the cipher itself under a different key, so nearby ids don't give related streams
+    uint32_t c[4] = { ( uint32_t )id, ( uint32_t )( id >> 32 ), ( uint32_t )stream, ( uint32_t )( stream >> 32 ) };
+    uint32_t k[2] = { key[0] ^ 0x5BD1E995, key[1] ^ 0x1B873593 };
+    philox( c, k );
+
+    RandomStream result( *this );
+    result.stream = ( ( uint64_t )c[1] << 32 ) | c[0];
+    result.counter = 0;
+    result.used = 4;
+    return result;
+}
+
+RandomStream RandomStream::lattice( int64_t j, int64_t i ) const
+{
+    return split( ( uint64_t )j ).split( ( uint64_t )i );
+}
+
+RandomStream RandomStream::point( double x, double y ) const
+{
+    uint64_t bx, by;
+    std::memcpy( &bx, &x, sizeof( bx ) );
+    std::memcpy( &by, &y, sizeof( by ) );
+    return split( bx ).split( by );
+}
+
+uint32_t RandomStream::get32()
+{
+    if( used >= 4 )
+        refill();
+    return block[used++];
+}
+
+uint64_t RandomStream::get64()
+{
+    uint64_t hi = get32();
+    return ( hi << 32 ) | get32();
+}
+
+double RandomStream::getReal( double min, double max )
+{
+    double unit = ( get64() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+    return min + ( max - min ) * unit;
+}
+
+int64_t RandomStream::getInteger( int64_t min, int64_t max )
+{
+    if( max <= min )
+        return min;
+
+    double range = ( double )max - ( double )min + 1;
+    auto result = min + ( int64_t )( getReal( 0, 1 ) * range );
+    return result > max ? max : result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+#include "RandomNumber.h"
+
+// Counter-based generator (Philox4x32-10)
+// Every value is a pure function of key, stream and position, so streams split by id, lattice cell or point
+// give the same numbers no matter in which order or on which thread they are consumed
+class RandomStream
+{
+private:
+    uint32_t key[2];
+    uint64_t stream, counter;
+    uint32_t block[4];
+    unsigned used;
+
+    void refill();
+public:
+    explicit RandomStream( uint64_t seed = 0 );
+    explicit RandomStream( RandomNumber &random );
+
+    RandomStream split( uint64_t id ) const;
+    RandomStream lattice( int64_t j, int64_t i ) const;
+    RandomStream point( double x, double y ) const;
+
+    uint32_t get32();
+    uint64_t get64();
+
+    // Uniform in [min, max)
+    double getReal( double min, double max );
+    // Uniform in [min, max]
+    int64_t getInteger( int64_t min, int64_t max );
+
+    // Key, stream, counter and position in the block, equal states give equal output
+    std::array<uint64_t, 4> state() const;
+
+    static void philox( uint32_t counter[4], const uint32_t key[2] );
+};
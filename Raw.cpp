@@ -0,0 +1,652 @@
+#include "Raw.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <atomic>
+
+#include "Basic.h"
+
+#include "ImageData.h"
+
+namespace Raw
+{
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    Format format;
+    Compression compression;
+    int32_t width, height;
+    uint64_t stride; // bytes between uncompressed rows, rows of chunks are not padded
+    uint64_t offset; // of pixel data, multiple of page
+    uint32_t rows;   // in every chunk but the last one
+    uint32_t chunks;
+};
+
+static const char magic[4] = { 'J', 'R', 'A', 'W' };
+static const uint32_t version = 1;
+static const uint64_t chunkBytes = 1 << 18;
+static const size_t batchChunks = 32; // compressed at once by writing
+
+template<typename P>
+struct Traits;
+
+template<>
+struct Traits<Pixel>
+{
+    static constexpr Format format = Format::bgra8;
+};
+
+template<>
+struct Traits<Composite::Pixel16>
+{
+    static constexpr Format format = Format::bgra16;
+};
+
+template<>
+struct Traits<PixelF>
+{
+    static constexpr Format format = Format::bgra32f;
+};
+
+static size_t pixelSize( Format format )
+{
+    switch( format )
+    {
+    case Format::bgra8:
+        return sizeof( Pixel );
+    case Format::bgra16:
+        return sizeof( Composite::Pixel16 );
+    case Format::bgra32f:
+        return sizeof( PixelF );
+    default:
+        return 0;
+    }
+}
+
+static uint64_t roundUp( uint64_t value, uint64_t step )
+{
+    return ( value + step - 1 ) / step * step;
+}
+
+Mapping::Mapping( const std::filesystem::path &path ) : origin( path ), file( INVALID_HANDLE_VALUE ), handle( nullptr ), bytes( nullptr ), length( 0 )
+{
+    file = CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+    if( file == INVALID_HANDLE_VALUE )
+        return;
+
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx( file, &size ) || size.QuadPart <= 0 )
+        return;
+
+    handle = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if( !handle )
+        return;
+
+    bytes = ( const unsigned char * )MapViewOfFile( handle, FILE_MAP_READ, 0, 0, 0 );
+    if( bytes )
+        length = ( size_t )size.QuadPart;
+}
+
+Mapping::~Mapping()
+{
+    if( bytes )
+        UnmapViewOfFile( bytes );
+    if( handle )
+        CloseHandle( handle );
+    if( file != INVALID_HANDLE_VALUE )
+        CloseHandle( file );
+}
+
+const unsigned char *Mapping::data() const
+{
+    return bytes;
+}
+
+size_t Mapping::size() const
+{
+    return length;
+}
+
+const std::filesystem::path &Mapping::source() const
+{
+    return origin;
+}
+
+// Upper bound of compressed size
+static size_t bound( size_t size )
+{
+    return size + size / 255 + 16;
+}
+
+// Greedy LZ77 with a hash table of four byte sequences, last five bytes are always literals
+static size_t compress( const unsigned char *source, size_t size, unsigned char *destination )
+{
+    const int bits = 14;
+    std::vector<uint32_t> table( ( size_t )1 << bits, 0 );
+
+    unsigned char *o = destination;
+    size_t anchor = 0, i = 0;
+
+    auto length = [&o]( size_t n )
+    {
+        for( ; n >= 255; n -= 255 )
+            *o++ = 255;
+        *o++ = ( unsigned char )n;
+    };
+
+    auto emit = [&]( size_t literals, size_t distance, size_t match )
+    {
+        auto token = o++;
+        *token = ( unsigned char )( Min( literals, ( size_t )15 ) << 4 );
+        if( literals >= 15 )
+            length( literals - 15 );
+        std::memcpy( o, source + anchor, literals );
+        o += literals;
+
+        if( !match )
+            return;
+
+        *o++ = ( unsigned char )distance;
+        *o++ = ( unsigned char )( distance >> 8 );
+        *token |= ( unsigned char )Min( match - 4, ( size_t )15 );
+        if( match - 4 >= 15 )
+            length( match - 4 - 15 );
+    };
+
+    if( size >= 13 )
+    {
+        size_t limit = size - 12;
+        while( i < limit )
+        {
+            uint32_t sequence, candidate;
+            std::memcpy( &sequence, source + i, 4 );
+            auto &slot = table[( sequence * 2654435761u ) >> ( 32 - bits )];
+            size_t reference = slot;
+            slot = ( uint32_t )i;
+
+            if( reference < i && i - reference <= 65535 )
+            {
+                std::memcpy( &candidate, source + reference, 4 );
+                if( candidate == sequence )
+                {
+                    size_t match = 4;
+                    while( i + match < size - 5 && source[reference + match] == source[i + match] )
+                        ++match;
+
+                    emit( i - anchor, i - reference, match );
+                    i += match;
+                    anchor = i;
+                    continue;
+                }
+            }
+            ++i;
+        }
+    }
+
+    emit( size - anchor, 0, 0 );
+    return o - destination;
+}
+
+static bool decompress( const unsigned char *source, size_t size, unsigned char *destination, size_t capacity )
+{
+    size_t i = 0, o = 0;
+
+    auto length = [&]( size_t &n )
+    {
+        unsigned char b;
+        do
+        {
+            if( i >= size )
+                return false;
+            b = source[i++];
+            n += b;
+        }
+        while( b == 255 );
+        return true;
+    };
+
+    while( i < size )
+    {
+        unsigned token = source[i++];
+
+        size_t literals = token >> 4;
+        if( literals == 15 && !length( literals ) )
+            return false;
+        if( literals > size - i || literals > capacity - o )
+            return false;
+        std::memcpy( destination + o, source + i, literals );
+        i += literals;
+        o += literals;
+
+        if( i == size )
+            break;
+
+        if( size - i < 2 )
+            return false;
+        size_t distance = source[i] | ( size_t )source[i + 1] << 8;
+        i += 2;
+        if( !distance || distance > o )
+            return false;
+
+        size_t match = token & 15;
+        if( match == 15 && !length( match ) )
+            return false;
+        match += 4;
+        if( match > capacity - o )
+            return false;
+
+        auto from = destination + o - distance, to = destination + o;
+        if( distance >= match )
+        {
+            std::memcpy( to, from, match );
+        }
+        else
+        {
+            for( size_t k = 0; k < match; ++k )
+                to[k] = from[k];
+        }
+        o += match;
+    }
+
+    return o == capacity;
+}
+
+View::View( const std::filesystem::path &path ) : View( std::make_shared<Mapping>( path ), 0, std::numeric_limits<uint64_t>::max() )
+{}
+
+View::View( std::shared_ptr<const Mapping> m, uint64_t begin, uint64_t size ) : mapping( std::move( m ) ), base( nullptr ), length( 0 ), type( Format::bgra8 ), packing( Compression::none ), width( 0 ), height( 0 ), stride( 0 ), offset( 0 ), rows( 0 )
+{
+    // Damaged containers release the mapping
+    auto parse = [&]()
+    {
+        if( !mapping || begin % page || begin > mapping->size() )
+            return false;
+
+        base = mapping->data() + begin;
+        length = Min( size, mapping->size() - begin );
+        if( length < sizeof( Header ) )
+            return false;
+
+        Header header;
+        std::memcpy( &header, base, sizeof( header ) );
+        if( std::memcmp( header.magic, magic, sizeof( magic ) ) || header.version != version )
+            return false;
+        if( header.width < 0 || header.height < 0 || header.offset % page || header.offset > length )
+            return false;
+
+        type = header.format;
+        packing = header.compression;
+        width = header.width;
+        height = header.height;
+        stride = header.stride;
+        offset = header.offset;
+        rows = header.rows;
+
+        size_t pixel = pixelSize( type );
+        if( !pixel )
+            return false;
+
+        uint64_t row = ( uint64_t )width * pixel, available = length - offset;
+        if( packing == Compression::none )
+        {
+            if( stride < row || ( height && stride > available / height ) )
+                return false;
+        }
+        else if( packing == Compression::fast )
+        {
+            if( height && ( !rows || header.chunks != ( height + ( uint64_t )rows - 1 ) / rows ) )
+                return false;
+            if( sizeof( Header ) + ( uint64_t )header.chunks * sizeof( uint64_t ) > offset )
+                return false;
+
+            chunks.resize( header.chunks );
+            if( header.chunks )
+                std::memcpy( chunks.data(), base + sizeof( Header ), chunks.size() * sizeof( uint64_t ) );
+
+            uint64_t total = 0;
+            for( auto c : chunks )
+            {
+                if( c > available - total )
+                    return false;
+                total += c;
+            }
+
+            // A compressed byte expands to at most 255 bytes, so damaged dimensions are rejected before allocation
+            if( row && ( uint64_t )height > ( uint64_t )std::numeric_limits<size_t>::max() / row )
+                return false;
+            for( size_t k = 0; k < chunks.size(); ++k )
+            {
+                uint64_t count = Min( ( uint64_t )rows, height - k * rows ), limit = chunks[k] * 255 + 255;
+                if( row && count > limit / row )
+                    return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    };
+
+    if( !parse() )
+        mapping.reset();
+}
+
+bool View::valid() const
+{
+    return mapping != nullptr;
+}
+
+int View::w() const
+{
+    return width;
+}
+
+int View::h() const
+{
+    return height;
+}
+
+Format View::format() const
+{
+    return type;
+}
+
+Compression View::compression() const
+{
+    return packing;
+}
+
+const void *View::row( int i ) const
+{
+    if( !mapping || packing != Compression::none || i < 0 || i >= height )
+        return nullptr;
+    return base + offset + stride * i;
+}
+
+template<typename P>
+bool View::load( MatrixBase<P> &image ) const
+{
+    if( !mapping || type != Traits<P>::format )
+        return false;
+
+    image.reset( width, height );
+    size_t row = ( size_t )width * sizeof( P );
+    if( !row )
+        return true;
+
+    if( packing == Compression::none )
+    {
+        Parallel::rows( height, [&]( int begin, int end )
+        {
+            for( int i = begin; i < end; ++i )
+                std::memcpy( image( 0, i ), this->row( i ), row );
+        } );
+        return true;
+    }
+
+    // Chunks start at known offsets, so they are decompressed concurrently
+    std::vector<uint64_t> starts( chunks.size() );
+    for( size_t k = 1; k < chunks.size(); ++k )
+        starts[k] = starts[k - 1] + chunks[k - 1];
+
+    std::atomic<bool> damaged( false );
+    Parallel::tasks( chunks.size(), [&]( size_t k )
+    {
+        int first = ( int )( k * rows ), count = Min( ( int )rows, height - first );
+        size_t size = row * count;
+
+        std::vector<unsigned char> buffer( size );
+        auto source = base + offset + starts[k];
+        if( chunks[k] == size )
+        {
+            std::memcpy( buffer.data(), source, size );
+        }
+        else if( !decompress( source, chunks[k], buffer.data(), size ) )
+        {
+            damaged = true;
+            return;
+        }
+
+        for( int i = 0; i < count; ++i )
+        {
+            auto d = buffer.data() + row * i;
+            auto o = ( unsigned char * )image( 0, first + i );
+            for( size_t j = 0; j < row; ++j )
+                o[j] = ( unsigned char )( d[j] + ( j >= sizeof( P ) ? o[j - sizeof( P )] : 0 ) );
+        }
+    } );
+
+    return !damaged;
+}
+
+// Stored format is loaded as it is and converted by DeepImage
+bool View::read( ImageDataBase &image ) const
+{
+    switch( type )
+    {
+    case Format::bgra8:
+        return load<Pixel>( image );
+    case Format::bgra16:
+    {
+        Image16 stored;
+        if( !load( stored ) )
+            return false;
+        stored.to( image );
+        return true;
+    }
+    case Format::bgra32f:
+    {
+        ImageF stored;
+        if( !load( stored ) )
+            return false;
+        stored.to( image );
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+template<typename D>
+static bool convert( const View &view, D &image )
+{
+    switch( view.format() )
+    {
+    case Format::bgra8:
+    {
+        ImageData stored;
+        if( !view.read( stored ) )
+            return false;
+        image.from( stored );
+        return true;
+    }
+    case Format::bgra16:
+    {
+        Image16 stored;
+        if( !view.read( stored ) )
+            return false;
+        image.from( stored );
+        return true;
+    }
+    case Format::bgra32f:
+    {
+        ImageF stored;
+        if( !view.read( stored ) )
+            return false;
+        image.from( stored );
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool View::read( Image16 &image ) const
+{
+    return type == Format::bgra16 ? load( image ) : convert( *this, image );
+}
+
+bool View::read( ImageF &image ) const
+{
+    return type == Format::bgra32f ? load( image ) : convert( *this, image );
+}
+
+template<typename P>
+static bool store( std::ostream &file, const MatrixBase<P> &image, Compression compression )
+{
+    int w = image.w(), h = image.h();
+    size_t row = ( size_t )w * sizeof( P );
+
+    Header header;
+    std::memcpy( header.magic, magic, sizeof( magic ) );
+    header.version = version;
+    header.format = Traits<P>::format;
+    header.compression = compression;
+    header.width = w;
+    header.height = h;
+    header.stride = 0;
+    header.rows = 0;
+    header.chunks = 0;
+
+    if( compression == Compression::fast )
+    {
+        header.rows = ( uint32_t )Max( ( uint64_t )1, chunkBytes / Max( row, ( size_t )1 ) );
+        header.chunks = h ? ( uint32_t )( ( h + ( uint64_t )header.rows - 1 ) / header.rows ) : 0;
+    }
+    else
+    {
+        header.stride = roundUp( row, 64 );
+    }
+
+    header.offset = roundUp( sizeof( Header ) + ( uint64_t )header.chunks * sizeof( uint64_t ), page );
+
+    // Sizes of chunks are known after they are written, their table is filled in then
+    auto start = file.tellp();
+    if( compression == Compression::fast && start < 0 )
+        return false;
+
+    std::vector<uint64_t> sizes( header.chunks, 0 );
+    std::vector<char> padding( page, 0 );
+    file.write( ( const char * )&header, sizeof( header ) );
+    file.write( ( const char * )sizes.data(), sizes.size() * sizeof( uint64_t ) );
+    file.write( padding.data(), header.offset - sizeof( Header ) - sizes.size() * sizeof( uint64_t ) );
+
+    if( compression == Compression::fast )
+    {
+        // Chunks are compressed concurrently a batch at a time, so only a batch is held in memory
+        std::vector<std::vector<unsigned char>> packed( Min( batchChunks, sizes.size() ) );
+        for( size_t first = 0; first < sizes.size() && file; first += packed.size() )
+        {
+            size_t count = Min( packed.size(), sizes.size() - first );
+            Parallel::tasks( count, [&]( size_t t )
+            {
+                int top = ( int )( ( first + t ) * header.rows ), n = Min( ( int )header.rows, h - top );
+                size_t size = row * n;
+                auto &result = packed[t];
+                result.clear();
+                if( !size )
+                    return;
+
+                std::vector<unsigned char> delta( size );
+                for( int i = 0; i < n; ++i )
+                {
+                    auto p = ( const unsigned char * )image( 0, top + i );
+                    auto d = delta.data() + row * i;
+                    for( size_t j = 0; j < row; ++j )
+                        d[j] = ( unsigned char )( p[j] - ( j >= sizeof( P ) ? p[j - sizeof( P )] : 0 ) );
+                }
+
+                // Chunks, that do not shrink, are stored as they are
+                result.resize( bound( size ) );
+                result.resize( compress( delta.data(), size, result.data() ) );
+                if( result.size() >= size )
+                    result = std::move( delta );
+            } );
+
+            for( size_t t = 0; t < count; ++t )
+            {
+                sizes[first + t] = packed[t].size();
+                file.write( ( const char * )packed[t].data(), packed[t].size() );
+            }
+        }
+
+        auto end = file.tellp();
+        file.seekp( start + ( std::streamoff )sizeof( Header ) );
+        file.write( ( const char * )sizes.data(), sizes.size() * sizeof( uint64_t ) );
+        file.seekp( end );
+    }
+    else
+    {
+        for( int i = 0; i < h && row; ++i )
+        {
+            file.write( ( const char * )image( 0, i ), row );
+            file.write( padding.data(), header.stride - row );
+        }
+    }
+
+    return ( bool )file;
+}
+
+template<typename P>
+static bool store( const std::filesystem::path &path, const MatrixBase<P> &image, Compression compression )
+{
+    std::error_code error;
+    if( path.has_parent_path() )
+        std::filesystem::create_directories( path.parent_path(), error );
+
+    std::ofstream file( path, std::ios::binary );
+    return file && store( file, image, compression );
+}
+
+bool matches( const std::filesystem::path &path )
+{
+    auto ext = path.extension().string();
+    std::transform( ext.begin(), ext.end(), ext.begin(), []( char c )
+    {
+        return std::toupper( c );
+    } );
+    return ext == ".RAW";
+}
+
+bool write( const std::filesystem::path &path, const ImageDataBase &image, Compression compression )
+{
+    return store( path, image, compression );
+}
+
+bool write( std::ostream &stream, const ImageDataBase &image, Compression compression )
+{
+    return store( stream, image, compression );
+}
+
+bool write( const std::filesystem::path &path, const Image16 &image, Compression compression )
+{
+    return store( path, image, compression );
+}
+
+bool write( const std::filesystem::path &path, const ImageF &image, Compression compression )
+{
+    return store( path, image, compression );
+}
+
+bool read( const std::filesystem::path &path, ImageDataBase &image )
+{
+    return View( path ).read( image );
+}
+
+bool read( const std::filesystem::path &path, Image16 &image )
+{
+    return View( path ).read( image );
+}
+
+bool read( const std::filesystem::path &path, ImageF &image )
+{
+    return View( path ).read( image );
+}
+}
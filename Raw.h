@@ -0,0 +1,104 @@
+#pragma once
+
+#include <filesystem>
+#include <ostream>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ImageDataBase.h"
+#include "DeepImage.h"
+
+// Native container for intermediate images, saved and loaded at disk speed
+// Header, table of chunk sizes, then pixel data at a page boundary
+namespace Raw
+{
+enum class Format : uint32_t
+{
+    bgra8,
+    bgra16,
+    bgra32f
+};
+
+// Fast mode delta codes rows against the pixel to the left and compresses chunks of rows
+// concurrently with byte oriented LZ77 in LZ4 block layout
+enum class Compression : uint32_t
+{
+    none,
+    fast
+};
+
+// Containers are placed at multiples of page in their files
+const uint64_t page = 4096;
+
+// Read only mapping of a whole file, shared by views of containers stored in it
+class Mapping
+{
+private:
+    std::filesystem::path origin;
+    void *file, *handle;
+    const unsigned char *bytes;
+    size_t length;
+public:
+    explicit Mapping( const std::filesystem::path &path );
+    Mapping( const Mapping & ) = delete;
+    Mapping &operator=( const Mapping & ) = delete;
+    ~Mapping();
+
+    // Empty for missing files
+    const unsigned char *data() const;
+    size_t size() const;
+    // Path the file was mapped by
+    const std::filesystem::path &source() const;
+};
+
+// Container in a mapped file, rows of uncompressed containers are read from the mapping directly
+class View
+{
+private:
+    std::shared_ptr<const Mapping> mapping;
+    const unsigned char *base;
+    uint64_t length;
+    Format type;
+    Compression packing;
+    int width, height;
+    uint64_t stride, offset;
+    uint32_t rows;
+    std::vector<uint64_t> chunks;
+
+    template<typename P>
+    bool load( MatrixBase<P> &image ) const;
+public:
+    explicit View( const std::filesystem::path &path );
+    View( std::shared_ptr<const Mapping> m, uint64_t begin, uint64_t size );
+
+    // False for missing or damaged files
+    bool valid() const;
+
+    int w() const;
+    int h() const;
+    Format format() const;
+    Compression compression() const;
+
+    // Start of row i in the mapping, nullptr for compressed files
+    const void *row( int i ) const;
+
+    // Pixels in their stored format, images of other formats are converted
+    bool read( ImageDataBase &image ) const;
+    bool read( Image16 &image ) const;
+    bool read( ImageF &image ) const;
+};
+
+// Paths with the raw extension in any case
+bool matches( const std::filesystem::path &path );
+
+bool write( const std::filesystem::path &path, const ImageDataBase &image, Compression compression = Compression::none );
+// Container is written at the position of stream, which has to be a multiple of page, fast compression needs a seekable stream
+bool write( std::ostream &stream, const ImageDataBase &image, Compression compression = Compression::none );
+bool write( const std::filesystem::path &path, const Image16 &image, Compression compression = Compression::none );
+bool write( const std::filesystem::path &path, const ImageF &image, Compression compression = Compression::none );
+
+bool read( const std::filesystem::path &path, ImageDataBase &image );
+bool read( const std::filesystem::path &path, Image16 &image );
+bool read( const std::filesystem::path &path, ImageF &image );
+}
@@ -0,0 +1,262 @@
+#include "Regions.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Basic.h"
+
+namespace Regions
+{
+Key::Key()
+{
+    alpha( 0 );
+}
+
+void Key::alpha( int t )
+{
+    type = Type::alpha;
+    color = Pixel( 0, 0, 0, 0 );
+    threshold = t;
+}
+
+void Key::background( const Pixel &c, int tolerance )
+{
+    type = Type::background;
+    color = c;
+    threshold = tolerance;
+}
+
+// Sums of a provisional label, merged into its root after labelling
+struct Statistics
+{
+    int left = std::numeric_limits<int>::max(), top = std::numeric_limits<int>::max();
+    int right = 0, bottom = 0;
+    uint64_t area = 0, x = 0, y = 0, r = 0, g = 0, b = 0, a = 0;
+    uint64_t first = std::numeric_limits<uint64_t>::max();
+
+    void add( int j, int i, const Pixel &p, uint64_t index )
+    {
+        left = Min( left, j );
+        top = Min( top, i );
+        right = Max( right, j + 1 );
+        bottom = Max( bottom, i + 1 );
+        ++area;
+        x += j;
+        y += i;
+        r += p.r;
+        g += p.g;
+        b += p.b;
+        a += p.a;
+        first = Min( first, index );
+    }
+
+    void merge( const Statistics &other )
+    {
+        left = Min( left, other.left );
+        top = Min( top, other.top );
+        right = Max( right, other.right );
+        bottom = Max( bottom, other.bottom );
+        area += other.area;
+        x += other.x;
+        y += other.y;
+        r += other.r;
+        g += other.g;
+        b += other.b;
+        a += other.a;
+        first = Min( first, other.first );
+    }
+};
+
+// Roots are the smallest labels of their sets
+static int find( std::vector<int> &parent, int k )
+{
+    while( parent[k] != k )
+    {
+        parent[k] = parent[parent[k]];
+        k = parent[k];
+    }
+    return k;
+}
+
+static void unite( std::vector<int> &parent, int u, int v )
+{
+    u = find( parent, u );
+    v = find( parent, v );
+    if( u < v )
+        parent[v] = u;
+    else if( v < u )
+        parent[u] = v;
+}
+
+Components::Components( const ImageDataBase &image, const Key &key, bool diagonal )
+{
+    int w = image.w(), h = image.h();
+
+    labels.reset( w, h );
+    if( w <= 0 || h <= 0 )
+        return;
+
+    // Stripes hold local labels starting from 1, their parents and statistics
+    int count = ( int )Min<long long>( h, Parallel::threads() * 4 );
+    std::vector<std::vector<int>> parents( count );
+    std::vector<std::vector<Statistics>> statistics( count );
+
+    auto begin = [&]( int s )
+    {
+        return ( int )( ( long long )h * s / count );
+    };
+
+    Parallel::tasks( count, [&]( size_t s )
+    {
+        auto &parent = parents[s];
+        auto &stats = statistics[s];
+        parent.push_back( 0 );
+        stats.emplace_back();
+
+        int i0 = begin( ( int )s ), i1 = begin( ( int )s + 1 );
+        for( int i = i0; i < i1; ++i )
+        {
+            auto p = image( 0, i );
+            auto l = labels( 0, i );
+            auto above = i > i0 ? labels( 0, i - 1 ) : nullptr;
+            for( int j = 0; j < w; ++j )
+            {
+                if( !key( p[j] ) )
+                {
+                    l[j] = 0;
+                    continue;
+                }
+
+                // Already labelled neighbours
+                int neighbours[4], n = 0;
+                if( j > 0 && l[j - 1] )
+                    neighbours[n++] = l[j - 1];
+                if( above )
+                {
+                    if( above[j] )
+                        neighbours[n++] = above[j];
+                    if( diagonal && j > 0 && above[j - 1] )
+                        neighbours[n++] = above[j - 1];
+                    if( diagonal && j + 1 < w && above[j + 1] )
+                        neighbours[n++] = above[j + 1];
+                }
+
+                int label;
+                if( !n )
+                {
+                    label = ( int )parent.size();
+                    parent.push_back( label );
+                    stats.emplace_back();
+                }
+                else
+                {
+                    label = neighbours[0];
+                    for( int k = 1; k < n; ++k )
+                    {
+                        unite( parent, label, neighbours[k] );
+                        label = Min( label, neighbours[k] );
+                    }
+                }
+
+                l[j] = label;
+                stats[label].add( j, i, p[j], ( uint64_t )i * w + j );
+            }
+        }
+    } );
+
+    // Global labels are local ones shifted by labels of preceding stripes
+    std::vector<int> offset( count + 1, 0 );
+    for( int s = 0; s < count; ++s )
+        offset[s + 1] = offset[s] + ( int )parents[s].size() - 1;
+
+    std::vector<int> parent( offset[count] + 1 );
+    parent[0] = 0;
+    for( int s = 0; s < count; ++s )
+    {
+        for( size_t k = 1; k < parents[s].size(); ++k )
+            parent[offset[s] + k] = offset[s] + find( parents[s], ( int )k );
+    }
+
+    // Pixels on both sides of a border between stripes are joined
+    for( int s = 1; s < count; ++s )
+    {
+        int i = begin( s );
+        if( i == begin( s - 1 ) )
+            continue;
+
+        auto l = labels( 0, i );
+        auto above = labels( 0, i - 1 );
+        for( int j = 0; j < w; ++j )
+        {
+            if( !l[j] )
+                continue;
+
+            int u = offset[s] + l[j];
+            for( int x = diagonal ? Max( j - 1, 0 ) : j; x <= ( diagonal ? Min( j + 1, w - 1 ) : j ); ++x )
+            {
+                if( above[x] )
+                    unite( parent, u, offset[s - 1] + above[x] );
+            }
+        }
+    }
+
+    // Statistics are gathered in roots, which are numbered by their first pixel
+    std::vector<Statistics> total( parent.size() );
+    std::vector<int> roots;
+    for( int s = 0; s < count; ++s )
+    {
+        for( size_t k = 1; k < parents[s].size(); ++k )
+            total[find( parent, offset[s] + ( int )k )].merge( statistics[s][k] );
+    }
+    for( size_t k = 1; k < parent.size(); ++k )
+    {
+        if( find( parent, ( int )k ) == ( int )k )
+            roots.push_back( ( int )k );
+    }
+
+    std::sort( roots.begin(), roots.end(), [&]( int u, int v )
+    {
+        return total[u].first < total[v].first;
+    } );
+
+    std::vector<int> number( parent.size(), 0 );
+    regions.resize( roots.size() );
+    for( size_t k = 0; k < roots.size(); ++k )
+    {
+        auto &t = total[roots[k]];
+        auto &region = regions[k];
+        number[roots[k]] = ( int )k + 1;
+
+        region.left = t.left;
+        region.top = t.top;
+        region.right = t.right;
+        region.bottom = t.bottom;
+        region.area = t.area;
+        region.x = ( double )t.x / t.area + 0.5;
+        region.y = ( double )t.y / t.area + 0.5;
+
+        auto mean = [&]( uint64_t sum )
+        {
+            return ( unsigned char )( ( sum + t.area / 2 ) / t.area );
+        };
+        region.mean = Pixel( mean( t.r ), mean( t.g ), mean( t.b ), mean( t.a ) );
+    }
+
+    for( size_t k = 1; k < parent.size(); ++k )
+        number[k] = number[find( parent, ( int )k )];
+
+    // Second pass replaces local labels by region numbers
+    Parallel::tasks( count, [&]( size_t s )
+    {
+        for( int i = begin( ( int )s ); i < begin( ( int )s + 1 ); ++i )
+        {
+            auto l = labels( 0, i );
+            for( int j = 0; j < w; ++j )
+            {
+                if( l[j] )
+                    l[j] = number[offset[s] + l[j]];
+            }
+        }
+    } );
+}
+}
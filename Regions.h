@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ImageDataBase.h"
+
+namespace Regions
+{
+// Decides, which pixels belong to regions
+class Key
+{
+public:
+    enum class Type
+    {
+        alpha,
+        background
+    };
+
+    Type type;
+    Pixel color;
+    int threshold;
+
+    Key();
+
+    // Pixels with alpha above threshold
+    void alpha( int t = 0 );
+    // Pixels, which differ from the background color by more than tolerance in some channel
+    void background( const Pixel &c, int tolerance = 0 );
+
+    bool operator()( const Pixel &p ) const
+    {
+        if( type == Type::alpha )
+            return p.a > threshold;
+
+        auto difference = []( int x, int y )
+        {
+            return x < y ? y - x : x - y;
+        };
+        return difference( p.r, color.r ) > threshold || difference( p.g, color.g ) > threshold ||
+               difference( p.b, color.b ) > threshold || difference( p.a, color.a ) > threshold;
+    }
+};
+
+class Region
+{
+public:
+    int left, top, right, bottom; // bounding box, right and bottom are exclusive
+    uint64_t area;
+    double x, y;                  // centroid of pixel centers
+    Pixel mean;
+};
+
+// Two pass union-find labelling, stripes of rows are labelled concurrently and merged at their borders
+// Label 0 is background, label k is regions[k - 1], regions are numbered by their first pixel in raster order
+class Components
+{
+public:
+    MatrixBase<int> labels;
+    std::vector<Region> regions;
+
+    Components( const ImageDataBase &image, const Key &key, bool diagonal = true );
+};
+}
@@ -0,0 +1,173 @@
+#include "RenderCache.h"
+
+#include <windows.h>
+
+#include <system_error>
+#include <cwchar>
+#include <thread>
+
+#include "ProceduralTextures.h"
+#include "Raw.h"
+
+const uint32_t RenderCache::version = 1;
+
+// FNV-1a over bytes of every argument
+void Digest::add( const void *data, size_t size )
+{
+    auto p = ( const unsigned char * )data;
+    for( size_t k = 0; k < size; ++k )
+    {
+        value ^= p[k];
+        value *= 0x100000001b3ull;
+    }
+}
+
+Digest::Digest( const std::string &generator ) : value( 0xcbf29ce484222325ull )
+{
+    *this << RenderCache::version << generator;
+}
+
+Digest &Digest::operator<<( const std::string &s )
+{
+    *this << ( uint64_t )s.size();
+    add( s.data(), s.size() );
+    return *this;
+}
+
+Digest &Digest::operator<<( const Color &c )
+{
+    return *this << c.r << c.g << c.b << c.a;
+}
+
+Digest &Digest::operator<<( const RandomStream &random )
+{
+    for( auto v : random.state() )
+        *this << v;
+    return *this;
+}
+
+Digest &Digest::operator<<( const Tissue &t )
+{
+    return *this << t.width << t.height << t.granule << t.vertical << t.horizontal << t.tangent << t.thickness << t.light << t.dark;
+}
+
+Digest &Digest::operator<<( const Trunk &t )
+{
+    *this << t.diameter << t.layerCount << t.variation << t.coreRatio << t.monotoneSliverAreaRatio << t.maximalDentRatio << t.power;
+    return *this << t.innerInside << t.innerOutside << t.outerInside << t.outerOutside;
+}
+
+uint64_t Digest::get() const
+{
+    return value;
+}
+
+RenderCache::RenderCache( const std::filesystem::path &f ) : folder( f )
+{}
+
+std::filesystem::path RenderCache::path( const Digest &digest ) const
+{
+    wchar_t name[17];
+    swprintf( name, 17, L"%016llx", ( unsigned long long )digest.get() );
+    return folder / ( std::wstring( name ) + L".raw" );
+}
+
+bool RenderCache::load( const Digest &digest, ImageDataBase &image ) const
+{
+    Raw::View view( path( digest ) );
+    return view.valid() && view.format() == Raw::Format::bgra8 && view.read( image );
+}
+
+bool RenderCache::store( const Digest &digest, const ImageDataBase &image ) const
+{
+    std::error_code error;
+    std::filesystem::create_directories( folder, error );
+
+    auto target = path( digest );
+    auto temporary = target;
+    temporary += L"." + std::to_wstring( GetCurrentProcessId() ) + L"." + std::to_wstring( std::hash<std::thread::id>()( std::this_thread::get_id() ) );
+
+    if( !Raw::write( temporary, image ) )
+    {
+        std::filesystem::remove( temporary, error );
+        return false;
+    }
+
+    // Another process may have stored the same digest meanwhile, both files are equal then
+    std::filesystem::rename( temporary, target, error );
+    if( error )
+    {
+        std::filesystem::remove( temporary, error );
+        return std::filesystem::exists( target, error );
+    }
+    return true;
+}
+
+void RenderCache::get( const Digest &digest, ImageDataBase &image, const std::function<void( ImageDataBase & )> &generate ) const
+{
+    if( load( digest, image ) )
+        return;
+
+    generate( image );
+    store( digest, image );
+}
+
+namespace Cached
+{
+template<typename G, typename... A>
+static void run( const RenderCache &cache, const std::string &name, ImageDataBase &image, G generator, const A &... arguments )
+{
+    cache.get( Digest( name, arguments... ), image, [&]( ImageDataBase & result )
+    {
+        generator( result, arguments... );
+    } );
+}
+
+void cellStructure( const RenderCache &cache, ImageDataBase &image, const RandomStream &random, int size, double minRadius, double maxRadius, size_t cellCount )
+{
+    run( cache, "cellStructure", image, []( ImageDataBase & result, const auto &... a )
+    {
+        ::cellStructure( result, a... );
+    }, random, size, minRadius, maxRadius, cellCount );
+}
+
+void tissueFragment( const RenderCache &cache, ImageDataBase &image, const Tissue &t )
+{
+    run( cache, "tissueFragment", image, []( ImageDataBase & result, const auto &... a )
+    {
+        ::tissueFragment( result, a... );
+    }, t );
+}
+
+void woodSlice( const RenderCache &cache, ImageDataBase &image, const RandomStream &random, const Trunk &t )
+{
+    run( cache, "woodSlice", image, []( ImageDataBase & result, const auto &... a )
+    {
+        ::woodSlice( result, a... );
+    }, random, t );
+}
+
+void watermelonPeel( const RenderCache &cache, ImageDataBase &image, const RandomStream &random )
+{
+    run( cache, "watermelonPeel", image, []( ImageDataBase & result, const auto &... a )
+    {
+        ::watermelonPeel( result, a... );
+    }, random );
+}
+
+void watermelonPulp( const RenderCache &cache, ImageDataBase &image, const RandomStream &random )
+{
+    run( cache, "watermelonPulp", image, []( ImageDataBase & result, const auto &... a )
+    {
+        ::watermelonPulp( result, a... );
+    }, random );
+}
+
+void randomImage( const RenderCache &cache, ImageDataBase &image, const RandomStream &random, int width, int height, int m, int n, int granulePower, double decayCoefficient )
+{
+    run( cache, "randomImage", image, []( ImageDataBase & result, const auto &... a )
+    {
+        ::randomImage( result, a... );
+    }, random, width, height, m, n, granulePower, decayCoefficient );
+}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <type_traits>
+#include <filesystem>
+#include <functional>
+#include <cstdint>
+#include <string>
+
+#include "ImageDataBase.h"
+
+class RandomStream;
+struct Tissue;
+struct Trunk;
+
+// Stable 64-bit digest of a generator and everything its output depends on
+class Digest
+{
+private:
+    uint64_t value;
+
+    void add( const void *data, size_t size );
+public:
+    explicit Digest( const std::string &generator );
+
+    template<typename... A>
+    Digest( const std::string &generator, const A &... arguments ) : Digest( generator )
+    {
+        ( *this << ... << arguments );
+    }
+
+    template<typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    Digest &operator<<( T v )
+    {
+        add( &v, sizeof( v ) );
+        return *this;
+    }
+
+    Digest &operator<<( const std::string &s );
+    Digest &operator<<( const Color &c );
+    Digest &operator<<( const RandomStream &random );
+    Digest &operator<<( const Tissue &t );
+    Digest &operator<<( const Trunk &t );
+
+    uint64_t get() const;
+};
+
+// Outputs of pure generators stored on disk by their digests
+// Files are written to a temporary name and renamed, so concurrent builds may share a folder
+class RenderCache
+{
+private:
+    std::filesystem::path folder;
+
+    std::filesystem::path path( const Digest &digest ) const;
+public:
+    // Part of every digest, increase it when some generator changes its output
+    static const uint32_t version;
+
+    explicit RenderCache( const std::filesystem::path &f );
+
+    bool load( const Digest &digest, ImageDataBase &image ) const;
+    bool store( const Digest &digest, const ImageDataBase &image ) const;
+
+    // Cached image or the result of generate, which is stored for the next time
+    void get( const Digest &digest, ImageDataBase &image, const std::function<void( ImageDataBase & )> &generate ) const;
+};
+
+// Generators through a cache, digests are made of the very arguments, which are passed to the generators
+namespace Cached
+{
+void cellStructure( const RenderCache &cache, ImageDataBase &image, const RandomStream &random, int size, double minRadius, double maxRadius, size_t cellCount );
+void tissueFragment( const RenderCache &cache, ImageDataBase &image, const Tissue &t );
+void woodSlice( const RenderCache &cache, ImageDataBase &image, const RandomStream &random, const Trunk &t );
+void watermelonPeel( const RenderCache &cache, ImageDataBase &image, const RandomStream &random );
+void watermelonPulp( const RenderCache &cache, ImageDataBase &image, const RandomStream &random );
+void randomImage( const RenderCache &cache, ImageDataBase &image, const RandomStream &random, int width, int height, int m, int n, int granulePower, double decayCoefficient );
+}
@@ -0,0 +1,262 @@
+#include "Resample.h"
+
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <list>
+#include <map>
+
+#include "Exception.h"
+#include "Basic.h"
+
+namespace Resample
+{
+static double support( Filter filter )
+{
+    switch( filter )
+    {
+    case Filter::box:
+        return 0.5;
+    case Filter::bilinear:
+        return 1;
+    case Filter::bicubic:
+        return 2;
+    case Filter::lanczos3:
+        return 3;
+    default:
+        makeException( false );
+    }
+    return 0;
+}
+
+static double sinc( double x )
+{
+    if( Abs( x ) < 1e-8 )
+        return 1;
+    x *= Pi();
+    return Sin( x ) / x;
+}
+
+static double kernel( Filter filter, double x )
+{
+    x = Abs( x );
+    switch( filter )
+    {
+    case Filter::box:
+        return x < 0.5 ? 1 : ( x > 0.5 ? 0 : 0.5 );
+    case Filter::bilinear:
+        return x < 1 ? 1 - x : 0;
+    case Filter::bicubic:
+        // Catmull-Rom
+        if( x < 1 )
+            return ( 1.5 * x - 2.5 ) * x * x + 1;
+        if( x < 2 )
+            return ( ( -0.5 * x + 2.5 ) * x - 4 ) * x + 2;
+        return 0;
+    case Filter::lanczos3:
+        return x < 3 ? sinc( x ) * sinc( x / 3 ) : 0;
+    default:
+        makeException( false );
+    }
+    return 0;
+}
+
+Weights::Weights( int source, int destination, Filter filter )
+{
+    makeException( source > 0 && destination > 0 );
+
+    // Downscaling stretches the filter over several source pixels
+    double scale = ( double )source / destination;
+    double stretch = Max( scale, 1.0 );
+    double radius = support( filter ) * stretch;
+
+    taps = Min( ( int )RoundUp( 2 * radius ) + 1, source );
+    first.resize( destination );
+    values.assign( ( size_t )destination * taps, 0.0f );
+
+    std::vector<double> row( taps );
+    for( int d = 0; d < destination; ++d )
+    {
+        double center = ( d + 0.5 ) * scale - 0.5;
+        int left = ( int )RoundUp( center - radius );
+        int right = ( int )RoundDown( center + radius );
+
+        // Pixels beyond the border are replaced by the border pixels
+        int start = Min( Max( left, 0 ), source - taps );
+        first[d] = start;
+
+        std::fill( row.begin(), row.end(), 0.0 );
+        double sum = 0;
+        for( int k = left; k <= right; ++k )
+        {
+            auto weight = kernel( filter, ( k - center ) / stretch );
+            row[Min( Max( k, 0 ), source - 1 ) - start] += weight;
+            sum += weight;
+        }
+
+        if( Abs( sum ) < 1e-12 )
+        {
+            row[Min( Max( ( int )Round( center ), 0 ), source - 1 ) - start] = 1;
+            sum = 1;
+        }
+
+        for( int t = 0; t < taps; ++t )
+            values[( size_t )d * taps + t] = row[t] / sum;
+    }
+}
+
+std::shared_ptr<const Weights> weights( int source, int destination, Filter filter )
+{
+    using Key = std::tuple<int, int, Filter>;
+    using Entry = std::pair<Key, std::shared_ptr<const Weights>>;
+
+    // Most recently used tables first, callers keep evicted tables alive while they use them
+    static const size_t capacity = 64;
+    static std::mutex mutex;
+    static std::list<Entry> recent;
+    static std::map<Key, std::list<Entry>::iterator> cache;
+
+    Key key{ source, destination, filter };
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        auto found = cache.find( key );
+        if( found != cache.end() )
+        {
+            recent.splice( recent.begin(), recent, found->second );
+            return found->second->second;
+        }
+    }
+
+    // Tables are built outside of the lock, a table built meanwhile by another thread is used instead
+    auto table = std::make_shared<const Weights>( source, destination, filter );
+
+    std::lock_guard<std::mutex> lock( mutex );
+    auto found = cache.find( key );
+    if( found != cache.end() )
+    {
+        recent.splice( recent.begin(), recent, found->second );
+        return found->second->second;
+    }
+
+    recent.emplace_front( key, table );
+    cache[key] = recent.begin();
+    if( recent.size() > capacity )
+    {
+        cache.erase( recent.back().first );
+        recent.pop_back();
+    }
+    return table;
+}
+
+void resize( const ImageDataBase &in, ImageDataBase &out, int w, int h, Filter filter )
+{
+    makeException( w > 0 && h > 0 );
+
+    if( static_cast<const ImageDataBase *>( &out ) == &in )
+    {
+        ImageData temporary;
+        resize( in, temporary, w, h, filter );
+        temporary.copy( out );
+        return;
+    }
+
+    int sw = in.w(), sh = in.h();
+    if( sw <= 0 || sh <= 0 )
+    {
+        out.reset( w, h, Pixel( 0, 0, 0, 0 ) );
+        return;
+    }
+
+    auto horizontalTable = weights( sw, w, filter ), verticalTable = weights( sh, h, filter );
+    auto &horizontal = *horizontalTable;
+    auto &vertical = *verticalTable;
+
+    // Horizontal pass into premultiplied floats, 4 per pixel in r, g, b, a order
+    std::vector<float> buffer( ( size_t )w * sh * 4 );
+    Parallel::rows( sh, [&]( int begin, int end )
+    {
+        for( int i = begin; i < end; ++i )
+        {
+            auto p = in( 0, i );
+            auto o = &buffer[( size_t )i * w * 4];
+            for( int j = 0; j < w; ++j, o += 4 )
+            {
+                auto k = &horizontal.values[( size_t )j * horizontal.taps];
+                auto s = p + horizontal.first[j];
+
+                float r = 0, g = 0, b = 0, a = 0;
+                for( int t = 0; t < horizontal.taps; ++t )
+                {
+                    float alpha = s[t].a * k[t];
+                    r += s[t].r * alpha;
+                    g += s[t].g * alpha;
+                    b += s[t].b * alpha;
+                    a += alpha;
+                }
+
+                o[0] = r;
+                o[1] = g;
+                o[2] = b;
+                o[3] = a;
+            }
+        }
+    } );
+
+    out.reset( w, h );
+
+    // Vertical pass adds whole rows, a loop the compiler vectorizes
+    Parallel::rows( h, [&]( int begin, int end )
+    {
+        std::vector<float> row( ( size_t )w * 4 );
+        for( int i = begin; i < end; ++i )
+        {
+            std::fill( row.begin(), row.end(), 0.0f );
+
+            auto k = &vertical.values[( size_t )i * vertical.taps];
+            for( int t = 0; t < vertical.taps; ++t )
+            {
+                auto weight = k[t];
+                auto s = &buffer[( size_t )( vertical.first[i] + t ) * w * 4];
+                auto o = row.data();
+                for( int x = 0; x < w * 4; ++x )
+                    o[x] += weight * s[x];
+            }
+
+            auto o = out( 0, i );
+            for( int j = 0; j < w; ++j )
+            {
+                auto c = &row[( size_t )j * 4];
+                auto channel = []( float v )
+                {
+                    return ( unsigned char )Min( Max( v + 0.5f, 0.0f ), 255.0f );
+                };
+
+                if( c[3] < 1e-3f )
+                {
+                    o[j] = Pixel( 0, 0, 0, 0 );
+                    continue;
+                }
+
+                o[j] = Pixel( channel( c[0] / c[3] ), channel( c[1] / c[3] ), channel( c[2] / c[3] ), channel( c[3] ) );
+            }
+        }
+    } );
+}
+
+void mipmaps( const ImageDataBase &image, std::vector<ImageData> &levels, Filter filter )
+{
+    levels.clear();
+    levels.emplace_back();
+    image.copy( levels.back() );
+
+    if( image.w() <= 0 || image.h() <= 0 )
+        return;
+
+    while( levels.back().w() > 1 || levels.back().h() > 1 )
+    {
+        levels.emplace_back();
+        auto &previous = levels[levels.size() - 2];
+        resize( previous, levels.back(), Max( previous.w() / 2, 1 ), Max( previous.h() / 2, 1 ), filter );
+    }
+}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "ImageDataBase.h"
+#include "ImageData.h"
+
+namespace Resample
+{
+enum class Filter
+{
+    box,
+    bilinear,
+    bicubic,
+    lanczos3
+};
+
+// Source pixels and their weights for every destination pixel along one axis
+// Every destination pixel reads taps consecutive source pixels starting at first, weights add up to 1
+class Weights
+{
+public:
+    int taps;
+    std::vector<int> first;
+    std::vector<float> values;
+
+    Weights( int source, int destination, Filter filter );
+};
+
+// Tables are shared between calls with the same sizes and filter, a bounded number of recently used tables is kept
+std::shared_ptr<const Weights> weights( int source, int destination, Filter filter );
+
+// Separable resampling of premultiplied colors, rows are processed concurrently
+void resize( const ImageDataBase &in, ImageDataBase &out, int w, int h, Filter filter = Filter::lanczos3 );
+
+// Level 0 is a copy of the image, every next level is half the previous one down to 1×1
+void mipmaps( const ImageDataBase &image, std::vector<ImageData> &levels, Filter filter = Filter::box );
+}
@@ -1,6 +1,7 @@
 #include "Common.h"
 
-#include "../Palette.h"
+#include <unordered_map>
+
 #include "../CheckProgress.h"
 
 static Cores cores;
@@ -85,11 +86,10 @@ bool LimitPalette( const ImageData &in, ImageData &out, double size )
 {
     Interval<unsigned char> r, g, b;
 
-    Palette groups[256];
     Cores coresCopy;
     Core next;
 
-    Pixel pi, *po;
+    Pixel pi;
     int i, j, k, m;
 
     out.reset( in.w(), in.h() );
@@ -114,6 +114,10 @@ bool LimitPalette( const ImageData &in, ImageData &out, double size )
         *globalText << ( ( double )( j * out.h() + i ) ) * 100 / ( out.w() * out.h() ) << "\n";
     };
 
+    // Cores are only appended, so a color always joins the group it joined first
+    std::unordered_map<uint32_t, int> groups;
+    MatrixBase<int> group( out.w(), out.h() );
+
     CheckProgress checkProgress( status, 3000 );
     for( j = 0; j < out.w(); ++j )
     {
@@ -121,6 +125,14 @@ bool LimitPalette( const ImageData &in, ImageData &out, double size )
         {
             pi = *in( j, i );
 
+            uint32_t key = ( ( uint32_t )pi.r << 24 ) | ( pi.g << 16 ) | ( pi.b << 8 ) | pi.a;
+            auto found = groups.find( key );
+            if( found != groups.end() )
+            {
+                *group( j, i ) = found->second;
+                continue;
+            }
+
             next.image = &in;
             next.i = i;
             next.j = j;
@@ -131,46 +143,27 @@ bool LimitPalette( const ImageData &in, ImageData &out, double size )
             {
                 ++m;
             }
-            if( m < k )
-            {
-                groups[m].add( pi );
-            }
-            else
+            if( m == k )
             {
                 coresCopy.cores.push_back( next );
-                groups[k].add( pi );
                 ++k;
             }
 
+            groups.emplace( key, m );
+            *group( j, i ) = m;
+
             checkProgress.check();
         }
     }
 
-    for( j = 0; j < out.w(); ++j )
+    out.function( out, [&]( int, int, int x, int y, const Pixel &, Pixel & po )
     {
-        for( i = 0; i < out.h(); ++i )
-        {
-            pi = *in( j, i );
-            po = out( j, i );
-
-            m = 0;
-            while( ( m < k ) && !groups[m].contains( pi ) )
-            {
-                ++m;
-            }
-            if( m < k )
-            {
-                po->r = 255 * Round( r.normalize( coresCopy.cores[m].c.r ) );
-                po->g = 255 * Round( g.normalize( coresCopy.cores[m].c.g ) );
-                po->b = 255 * Round( b.normalize( coresCopy.cores[m].c.b ) );
-                po->a = 255;
-            }
-            else
-            {
-                return false;
-            }
-        }
-    }
+        auto &c = coresCopy.cores[*group( x, y )].c;
+        po.r = 255 * Round( r.normalize( c.r ) );
+        po.g = 255 * Round( g.normalize( c.g ) );
+        po.b = 255 * Round( b.normalize( c.b ) );
+        po.a = 255;
+    } );
     return true;
 }
 
@@ -1,7 +1,10 @@
 #include "Test_00_save_and_load.h"
 
+#include "../RandomStream.h"
 #include "../ImageWindow.h"
+#include "../Comparison.h"
 #include "../ImageData.h"
+#include "../Raw.h"
 
 void Test_00_save_and_load( Context &context )
 {
@@ -25,6 +28,7 @@ void Test_00_save_and_load( Context &context )
         L"input\\p32.bmp",
         L"input\\n32.bmp",
         L"input\\p.png",
+        L"input\\p32.bmp",
     };
 
     const std::vector<std::filesystem::path> outputs0 =
@@ -34,6 +38,7 @@ void Test_00_save_and_load( Context &context )
         context.Output() / L"0_p32.bmp",
         context.Output() / L"0_n32.bmp",
         context.Output() / L"0_p.png",
+        context.Output() / L"0_p32.raw",
     };
 
     const std::vector<std::filesystem::path> outputs1 =
@@ -43,6 +48,7 @@ void Test_00_save_and_load( Context &context )
         context.Output() / L"1_p32.bmp",
         context.Output() / L"1_n32.bmp",
         context.Output() / L"1_p.png",
+        context.Output() / L"1_p32.raw",
     };
 
     ImageData in;
@@ -80,6 +86,36 @@ void Test_00_save_and_load( Context &context )
         debugInfo( outputs0[i], outputs1[i] );
     }
 
+    {
+        // Compressed containers are read back unchanged, chunks of noise do not shrink and are stored as they are
+        auto roundTrip = [&]( const ImageDataBase & image, const std::filesystem::path & path )
+        {
+            ImageData back;
+            makeException( Raw::write( path, image, Raw::Compression::fast ) && Raw::read( path, back ) );
+            makeException( Comparison::compare( back, image ).identical );
+        };
+
+        ImageData picture;
+        if( picture.input( L"input\\p.png" ) )
+            roundTrip( picture, context.Output() / L"fast_p.raw" );
+
+        ImageData mixed;
+        mixed.reset( 512, 384 );
+        RandomStream random( 1 );
+        for( int i = 0; i < mixed.h(); ++i )
+        {
+            for( int j = 0; j < mixed.w(); ++j )
+            {
+                auto v = ( uint32_t )random.getInteger( 0, 0xFFFFFFFF );
+                if( i < 128 )
+                    *mixed( j, i ) = Pixel( ( unsigned char )( j / 2 ), ( unsigned char )i, 0 );
+                else
+                    *mixed( j, i ) = Pixel( ( unsigned char )v, ( unsigned char )( v >> 8 ), ( unsigned char )( v >> 16 ), ( unsigned char )( v >> 24 ) );
+            }
+        }
+        roundTrip( mixed, context.Output() / L"fast_mixed.raw" );
+    }
+
     if( inputVariableData )
     {
         text << L"Open input\\load_this.png\n";
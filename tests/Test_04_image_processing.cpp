@@ -1,10 +1,18 @@
 #include "Test_04_image_processing.h"
 
-#include "../ApplyKernel.h"
+#include <fstream>
+
+#include "../Quantization.h"
 #include "../ImageWindow.h"
+#include "../Comparison.h"
+#include "../Composite.h"
+#include "../Distance.h"
 #include "../ImageData.h"
-#include "../Outline.h"
+#include "../Resample.h"
+#include "../Pipeline.h"
+#include "../Palette.h"
 #include "../Filters.h"
+#include "../Edges.h"
 
 void Test_04_image_processing( Context &context )
 {
@@ -17,6 +25,77 @@ void Test_04_image_processing( Context &context )
     bool additional = info( L"additional" ).as<bool>();
     bool showImages = info( L"showImages" ).as<bool>();
 
+    // Palette counts a known image, merges counts of another one and saves colors most frequent first
+    {
+        Pixel red( 255, 0, 0 ), green( 0, 255, 0 ), blue( 0, 0, 255 );
+
+        ImageData image;
+        image.reset( 8, 4 );
+        for( int i = 0; i < image.h(); ++i )
+        {
+            for( int j = 0; j < image.w(); ++j )
+                *image( j, i ) = i < 3 ? red : j < 6 ? green : blue;
+        }
+
+        Palette palette, other;
+        palette.add( image );
+        other.add( blue, 5 );
+        palette.merge( other );
+        makeException( palette.size() == 3 && palette.count( red ) == 24 && palette.count( green ) == 6 && palette.count( blue ) == 7 );
+
+        auto colors = palette.sorted();
+        makeException( colors.size() == 3 && colors[0].first == red && colors[1].first == blue && colors[2].first == green );
+
+        if( writeDisk )
+        {
+            auto path = context.Output() / L"palette.bin";
+            makeException( palette.out( path ) );
+
+            std::ifstream file( path, std::ios::binary );
+            uint32_t n = 0;
+            file.read( ( char * )&n, sizeof( n ) );
+            makeException( file && n == colors.size() );
+            for( auto &[color, count] : colors )
+            {
+                Pixel c;
+                uint64_t k = 0;
+                file.read( ( char * )&c, sizeof( c ) );
+                file.read( ( char * )&k, sizeof( k ) );
+                makeException( file && c == color && k == count );
+            }
+        }
+    }
+
+    // Transparent margins of a sprite leave semi-transparent pixels below them as they were
+    {
+        ImageData canvas, before, sprite;
+        canvas.reset( 16, 16 );
+        for( int i = 0; i < canvas.h(); ++i )
+        {
+            for( int j = 0; j < canvas.w(); ++j )
+                *canvas( j, i ) = Pixel( 17 * j, 255 - 13 * i, 100 + i + j, 3 + i );
+        }
+        canvas.copy( before );
+
+        Pixel opaque( 200, 100, 50 );
+        sprite.reset( 8, 8, Pixel( 0, 0, 0, 0 ) );
+        for( int i = 2; i < 6; ++i )
+        {
+            for( int j = 2; j < 6; ++j )
+                *sprite( j, i ) = opaque;
+        }
+
+        sprite.placeTransperent( canvas, 4, 4 );
+        for( int i = 0; i < canvas.h(); ++i )
+        {
+            for( int j = 0; j < canvas.w(); ++j )
+            {
+                bool covered = 6 <= j && j < 10 && 6 <= i && i < 10;
+                makeException( *canvas( j, i ) == ( covered ? opaque : *before( j, i ) ) );
+            }
+        }
+    }
+
     if( !readDisk )
         return;
 
@@ -153,6 +232,77 @@ void Test_04_image_processing( Context &context )
             in.function( out, Filters::rainbowPie );
             return L"rainbowPie";
         },
+        []( const ImageData & in, ImageData & out )
+        {
+            Pipeline( in ).function( Filters::gray ).function( Filters::grayOut ).function( Filters::fiveSectors ).invert().shiftRGB( 0, 0, 10, 10, 20, 20 ).evaluate( out );
+            return L"pipeline";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            in.map( out, pure( []( const Color & u, Color & v )
+            {
+                v.r = Sqrt( u.r );
+                v.g = Sqrt( u.g );
+                v.b = Sqrt( u.b );
+                v.a = u.a;
+            } ) );
+            return L"sqrtMap";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            in.map( out, pure( Filters::gray ) );
+            return L"grayMap";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            in.map( out, pure( Filters::function3 ) );
+            return L"function3Map";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Quantization::quantize( in, out, 256 );
+            return L"quantize256";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Quantization::quantize( in, out, 16, true );
+            return L"quantize16dither";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Resample::resize( in, out, Max( in.w() / 3, 1 ), Max( in.h() / 3, 1 ), Resample::Filter::lanczos3 );
+            return L"resizeLanczos3";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Filters::Rank filter;
+            filter.median( 5 );
+            Filters::rank( filter, in, out );
+            return L"median5";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Filters::Rank filter;
+            filter.erode( 2 );
+            filter.border = Filters::Border::mirror;
+            Filters::rank( filter, in, out );
+            return L"erode2";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Filters::Blur filter;
+            filter.gaussian( 20 );
+            Filters::blur( filter, in, out );
+            return L"recursiveGaussian20";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Filters::Blur filter;
+            filter.box( 15 );
+            filter.border = Filters::Border::extend;
+            Filters::blur( filter, in, out );
+            return L"boxBlur15";
+        },
         [&params]( const ImageData & in, ImageData & out )
         {
             params.blurGaussian( 3, 0.849322 );
@@ -161,13 +311,38 @@ void Test_04_image_processing( Context &context )
         },
         []( const ImageData & in, ImageData & out )
         {
-            ApplyKernel( in, out );
-            return L"ApplyKernel";
+            Edges::canny( in, out );
+            return L"canny";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Edges::magnitude( in, out );
+            return L"gradientMagnitude";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Regions::Key key;
+            key.background( Pixel( 0, 0, 0 ), 127 );
+            Distance::field( in, out, key, 16 );
+            return L"signedDistance";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            in.copy( out );
+            Composite::compose( in, out, in.w() / 4, in.h() / 4, Composite::Blend::overlay );
+            return L"overlayShifted";
         },
         []( const ImageData & in, ImageData & out )
         {
-            Outline( in, out );
-            return L"Outline";
+            Filters::Convolution filter;
+            filter.blurGaussian( 5 );
+
+            ImageF deep;
+            deep.from( in );
+            for( int i = 0; i < 4; ++i )
+                Filters::convolution( filter, deep, deep );
+            deep.to( out );
+            return L"floatGaussianChain";
         },
         [&params]( const ImageData & in, ImageData & out )
         {
@@ -193,6 +368,23 @@ void Test_04_image_processing( Context &context )
             Filters::convolution( params, in, out );
             return L"operatorSobelVertical";
         },
+        []( const ImageData & in, ImageData & out )
+        {
+            Filters::Convolution filter;
+            filter.operatorSobel( false );
+            filter.range = Filters::Range::kernel;
+            Filters::convolution( filter, in, out );
+            return L"operatorSobelKernelRange";
+        },
+        []( const ImageData & in, ImageData & out )
+        {
+            Filters::Convolution filter;
+            filter.highPass();
+            filter.range = Filters::Range::clamp;
+            Filters::convolution( filter, in, out );
+            Filters::normalize( out, out );
+            return L"highPassClampNormalize";
+        },
         [&params]( const ImageData & in, ImageData & out )
         {
             params.sharpening();
@@ -261,6 +453,9 @@ void Test_04_image_processing( Context &context )
         }
     };
 
+    std::vector<Comparison::Pair> pairs;
+    std::filesystem::path inputName;
+
     auto demonstrateAndSave = [&]( const std::wstring & name )
     {
         text << name << L"\n";
@@ -270,16 +465,76 @@ void Test_04_image_processing( Context &context )
             window.run();
         }
         if( writeDisk )
-            output.output( context.Output() / ( name + L".png" ) );
+        {
+            auto path = context.Output() / ( name + L".png" );
+            output.output( path );
+
+            // Every input has its own golden images
+            auto baseline = std::filesystem::path( L"baseline" ) / inputName / path.filename();
+            if( std::filesystem::exists( baseline ) || std::filesystem::exists( Comparison::hashPath( baseline ) ) )
+                pairs.push_back( { path, baseline } );
+        }
+    };
+
+    // Saved results are compared against golden images, when there are any
+    auto compareBaselines = [&]()
+    {
+        Comparison::Tolerance tolerance;
+        tolerance.channel = 1;
+        tolerance.ssim = 0.99;
+
+        auto results = Comparison::compare( pairs, tolerance );
+        for( size_t k = 0; k < results.size(); ++k )
+        {
+            auto &result = results[k];
+            if( result.passed )
+                continue;
+
+            text << L"Differs from baseline: " << pairs[k].actual.filename().native() << L"\n";
+            ++text;
+            if( result.loaded )
+                text << L"Mismatched pixels: " << result.mismatched << L", largest difference: " << result.maximum << L"\n";
+            else
+                text << L"Can't read images.\n";
+            --text;
+        }
+        pairs.clear();
+    };
+
+    // Fused pipeline has to give exactly the pixels of separate operations
+    auto checkPipeline = [&]()
+    {
+        Filters::Convolution blur;
+        blur.blurGaussian( 5 );
+        blur.border = Filters::Border::mirror;
+
+        ImageData fused, separate, temporary;
+        Pipeline( input ).function( Filters::gray ).function( Filters::fiveSectors ).invert().shiftRGB( 0, 0, 10, 10, 20, 20 )
+        .function( Filters::function2 ).convolution( blur ).invert().function( Filters::grayOut ).evaluate( fused );
+
+        input.function( separate, Filters::gray );
+        separate.function( temporary, Filters::fiveSectors );
+        temporary.invert( separate );
+        separate.shiftRGB( temporary, 0, 0, 10, 10, 20, 20 );
+        temporary.function( separate, Filters::function2 );
+        Filters::convolution( blur, separate, temporary );
+        temporary.invert( separate );
+        separate.function( temporary, Filters::grayOut );
+
+        makeException( Comparison::compare( fused, temporary ).identical );
     };
 
     for( const auto &path : paths )
     {
         if( !input.input( path ) )
             continue;
+        inputName = path.stem();
+
+        checkPipeline();
 
         for( const auto &processor : processors )
             demonstrateAndSave( processor( input, output ) );
+        compareBaselines();
 
         if( !additional )
             break;
@@ -1,6 +1,7 @@
 #include "Test_15_DDS.h"
 
 #include "../ImageData.h"
+#include "../Resample.h"
 
 void Test_15_DDS( Context &context )
 {
@@ -33,4 +34,19 @@ void Test_15_DDS( Context &context )
     img[0].output( context.Output() / L"frame0.png" );
     img[1].output( context.Output() / L"frame1.png" );
     img[2].output( context.Output() / L"frame2.png" );
+
+    std::vector<ImageData> levels;
+    Resample::mipmaps( img[0], levels );
+    ImageData::writeDDS( context.Output() / L"mipmaps.dds", levels, true );
+
+    levels.clear();
+
+    if( !ImageData::readDDS( context.Output() / L"mipmaps.dds", levels ) || levels.size() < 2 )
+    {
+        text << L"Failed to input mipmaps.\n";
+        return;
+    }
+
+    text << levels.size() << L"\n";
+    levels[1].output( context.Output() / L"mipmap1.png" );
 }
@@ -2,9 +2,11 @@
 
 #include "../ImageWindow.h"
 #include "../ImageData.h"
+#include "../Regions.h"
 
 void Test_25_remove_checkered_pattern( Context &context )
 {
+    auto &text = context.output();
     auto s = context.scope( __FUNCTION__ );
 
     auto &info = context.information;
@@ -36,6 +38,12 @@ void Test_25_remove_checkered_pattern( Context &context )
         }
     } );
 
+    // Pieces, that were separated by the pattern
+    Regions::Key key;
+    key.background( Pixel( 255, 0, 255 ) );
+    Regions::Components components( output, key );
+    text << L"Regions: " << std::to_wstring( components.regions.size() ) << L"\n";
+
     if( showImages )
     {
         ImageWindow window( output, nullptr );
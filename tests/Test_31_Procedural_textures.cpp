@@ -1,6 +1,7 @@
 #include "Test_31_Procedural_textures.h"
 
 #include "../ProceduralTextures.h"
+#include "../RenderCache.h"
 
 #include "../ImageWindow.h"
 #include "../ImageData.h"
@@ -40,6 +41,14 @@ void Test_31_Procedural_textures( Context &context )
         image.output( context.Output() / ( L"cell_structure" + std::to_wstring( i ) + L".png" ) );
     }
 
+    {
+        // Generated once, later runs read it from the cache
+        RenderCache cache( context.Output() / L"cache" );
+        RandomStream random( 10000 );
+        Cached::cellStructure( cache, image, random, 2048, 0.004, 0.008, 10000 );
+        image.output( context.Output() / L"cell_structure_dense.png" );
+    }
+
     /*
     {
         RandomNumber random;
@@ -1,8 +1,10 @@
 #include "Test_32_JustEdit.h"
 
 #include "../ImageWindow.h"
+#include "../Comparison.h"
 #include "../ImageData.h"
 #include "../JustEdit.h"
+#include "../Journal.h"
 
 #include "Information.h"
 
@@ -37,6 +39,21 @@ void Test_32_JustEdit( Context &context )
     rectangle.fill = Color( 1, 0.5, 0 );
     rectangle.thickness = 1;
 
+    {
+        // Changes go through the journal and are undone in reverse order
+        JustEdit::Journal journal;
+        journal.field( &rectangle, L"width", L"24" );
+        journal.add( &raster, std::make_shared<JustEdit::Circle>( L"circle1", Vector2D( 96, 32 ), 8 ) );
+
+        journal.undo();
+        journal.undo();
+        makeException( Abs( rectangle.w - 16 ) <= 1e-9 && raster.getNodes().size() == 3 );
+
+        journal.redo();
+        journal.redo();
+        makeException( Abs( rectangle.w - 24 ) <= 1e-9 && raster.getNodes().size() == 4 );
+    }
+
     {
         ImageData image;
         image.reset( 512, 512 );
@@ -44,7 +61,56 @@ void Test_32_JustEdit( Context &context )
         window.run();
     }
 
-    makeException( root.save( context.Output() / L"save.jei" ) );
+    auto path = context.Output() / L"save.jei";
+    makeException( root.save( path ) );
+
+    // Pixels as they were saved, the originals are decoded from the document later
+    ImageData rootPixels, rasterPixels;
+    root.pixels().copy( rootPixels );
+    raster.pixels().copy( rasterPixels );
+
+    // Document read back from the binary format has the same tree, fields and pixels
+    auto check = [&]( const std::shared_ptr<JustEdit::Entity>& document )
+    {
+        auto savedRoot = dynamic_cast<JustEdit::Raster*>( document.get() );
+        makeException( savedRoot && savedRoot->name == L"root" && savedRoot->getNodes().size() == 1 && savedRoot->fill == root.fill );
+
+        auto savedRaster = dynamic_cast<JustEdit::Raster*>( savedRoot->getNodes().front() );
+        makeException( savedRaster && savedRaster->name == L"raster0" && savedRaster->getNodes().size() == 4 && savedRaster->fill == raster.fill );
+        makeException( Abs( savedRaster->position.rotation - raster.position.rotation ) <= 1e-9 && Abs( savedRaster->position.scaleY - 2 ) <= 1e-9 );
+
+        auto savedRectangle = dynamic_cast<JustEdit::Rectangle*>( savedRaster->getNodes()[2] );
+        makeException( savedRectangle && savedRectangle->name == L"rectangle0" && Abs( savedRectangle->w - 24 ) <= 1e-9 && savedRectangle->fill == rectangle.fill );
+
+        auto savedLine = dynamic_cast<JustEdit::Line*>( savedRaster->getNodes()[1] );
+        makeException( savedLine && Abs( savedLine->thickness - 4 ) <= 1e-9 && savedLine->contour == line.contour );
+
+        makeException( Comparison::compare( savedRoot->pixels(), rootPixels ).identical );
+        makeException( Comparison::compare( savedRaster->pixels(), rasterPixels ).identical );
+    };
+
+    {
+        auto saved = JustEdit::Entity::load( path );
+        check( saved );
+
+        // Rasters are decoded on first use, with a budget smaller than one raster drawing evicts and decodes them again
+        auto budget = JustEdit::Raster::budget();
+        JustEdit::Raster::budget( 1 );
+        for( int k = 0; k < 2; ++k )
+        {
+            ImageData image;
+            image.reset( 512, 512 );
+            Overlap::Canvas canvas( image );
+            saved->draw( Affine2D( Vector2D() ), canvas );
+            canvas.render( image );
+        }
+
+        // Saved over the file it was loaded from, the rasters are bound to the new file then
+        makeException( saved->save( path ) );
+        check( saved );
+        check( JustEdit::Entity::load( path ) );
+        JustEdit::Raster::budget( budget );
+    }
 
     auto nextRoot = root.load( context.Input() / L"load.jei" );
     makeException( nextRoot );
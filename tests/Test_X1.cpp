@@ -4,7 +4,7 @@
 
 #include "../ImageWindow.h"
 #include "../ImageData.h"
-#include "../Outline.h"
+#include "../Edges.h"
 
 #include "Common.h"
 
@@ -29,7 +29,7 @@ void Test_X1( Context &context )
 
     if( in.input( path0.wstring() ) )
     {
-        Outline( in, out );
+        Edges::magnitude( in, out );
         out.output( path1.wstring() );
     }
 }
@@ -2,9 +2,9 @@
 
 #include "Window.h"
 
-#include "../ApplyKernel.h"
 #include "../ImageWindow.h"
 #include "../ImageData.h"
+#include "../Edges.h"
 
 #include "Common.h"
 
@@ -26,7 +26,7 @@ void Test_X2( Context &context )
 
     if( in.input( path0.wstring() ) )
     {
-        ApplyKernel( in, out );
+        Edges::canny( in, out );
         out.output( path1.wstring() );
     }
 }
@@ -2,9 +2,9 @@
 
 #include "Window.h"
 
-#include "../ApplyKernel.h"
 #include "../ImageWindow.h"
 #include "../ImageData.h"
+#include "../Edges.h"
 
 #include "Common.h"
 
@@ -26,7 +26,7 @@ void Test_X3( Context &context )
     path1.append( "test13.png" );
 
     in.input( path0.wstring() );
-    ApplyKernel( in, ou0 );
+    Edges::canny( in, ou0 );
 
     getCores().image = &ou0;
     ImageWindow window( ou0, nullptr );